@@ -0,0 +1,45 @@
+/** file yacasys/bench/batches.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** Many tiny tasks added by batches from this thread, then run by the
+   workers, which also take them by batches. **/
+
+#define BENCH_NBTASKS 1048576	/* tasks added in all */
+#define BENCH_BATCH 256		/* tasks in each batch */
+
+void
+bench_batches (void)
+{
+  struct yaca_item_st **tasks = bench_task_items (BENCH_NBTASKS);
+  bench_tasks_expect (BENCH_NBTASKS);
+  double start = bench_clock ();
+  for (unsigned long n = 0; n < BENCH_NBTASKS; n += BENCH_BATCH)
+    yaca_agenda_add_batch (tasks + n, BENCH_BATCH, tkprio_normal);
+  bench_tasks_wait ();
+  double wall = bench_clock () - start;
+  printf ("%-24s %9.1f ns/task, %d tasks in %.3f s\n", "agenda batches",
+	  1.0e9 * wall / BENCH_NBTASKS, BENCH_NBTASKS, wall);
+}
+
+/* eof yacasys/bench/batches.c */
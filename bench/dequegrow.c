@@ -0,0 +1,75 @@
+/** file yacasys/bench/dequegrow.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** The latency of pushing many tasks into the deque of a worker, whose
+   ring grows by incremental migration. The other workers wait meanwhile
+   in their measuring task, so that they steal nothing before the end of
+   the pushes; the tail of the latency shows the growth spikes. **/
+
+#define BENCH_NBTASKS 1048576	/* tasks pushed by the first worker */
+
+static struct
+{
+  struct yaca_item_st **tasks;
+  double *latencies;
+  bool pushed;			/* atomically set */
+} dequegrow;
+
+static unsigned long
+bench_dequegrow_worker (unsigned ix)
+{
+  if (ix > 0)
+    {
+      while (!__atomic_load_n (&dequegrow.pushed, __ATOMIC_ACQUIRE))
+	sched_yield ();
+      return 0;
+    }
+  for (unsigned long n = 0; n < BENCH_NBTASKS; n++)
+    {
+      double start = bench_clock ();
+      yaca_agenda_add_back (dequegrow.tasks[n], tkprio_normal);
+      dequegrow.latencies[n] = bench_clock () - start;
+    }
+  __atomic_store_n (&dequegrow.pushed, true, __ATOMIC_RELEASE);
+  return BENCH_NBTASKS;
+}
+
+void
+bench_dequegrow (void)
+{
+  dequegrow.tasks = bench_task_items (BENCH_NBTASKS);
+  dequegrow.latencies = calloc (BENCH_NBTASKS, sizeof (double));
+  if (!dequegrow.latencies)
+    YACA_FATAL ("out of memory for the deque latencies");
+  dequegrow.pushed = false;
+  bench_tasks_expect (BENCH_NBTASKS);
+  bench_on_workers ("deque push", bench_dequegrow_worker);
+  bench_tasks_wait ();
+  bench_print_latencies ("deque push, 1M queued", dequegrow.latencies,
+			 BENCH_NBTASKS);
+  free (dequegrow.latencies);
+  dequegrow.latencies = NULL;
+}
+
+/* eof yacasys/bench/dequegrow.c */
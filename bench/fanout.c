@@ -0,0 +1,56 @@
+/** file yacasys/bench/fanout.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** Many tiny tasks added by the workers, which go to their own deques,
+   and may be stolen by the others. **/
+
+#define BENCH_NBTASKS 1048576	/* tasks added in all */
+
+static struct yaca_item_st **bench_fanout_tasks;
+
+static unsigned long
+bench_fanout_worker (unsigned ix)
+{
+  unsigned long nb = BENCH_NBTASKS / bench_nbworkers;
+  struct yaca_item_st **tasks = bench_fanout_tasks + ix * nb;
+  for (unsigned long n = 0; n < nb; n++)
+    yaca_agenda_add_back (tasks[n], tkprio_normal);
+  return nb;
+}
+
+void
+bench_fanout (void)
+{
+  unsigned long nbtasks = BENCH_NBTASKS - BENCH_NBTASKS % bench_nbworkers;
+  bench_fanout_tasks = bench_task_items (nbtasks);
+  bench_tasks_expect (nbtasks);
+  double start = bench_clock ();
+  bench_on_workers ("agenda add in worker", bench_fanout_worker);
+  bench_tasks_wait ();
+  double wall = bench_clock () - start;
+  printf ("%-24s %9.1f ns/task, %lu tasks in %.3f s\n",
+	  "agenda from workers", 1.0e9 * wall / nbtasks, nbtasks, wall);
+}
+
+/* eof yacasys/bench/fanout.c */
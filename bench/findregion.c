@@ -0,0 +1,50 @@
+/** file yacasys/bench/findregion.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** The lookup of the region of some pointer, which never locks, done
+   on every worker at once. **/
+
+#define BENCH_NBLOOKUPS 2000000
+#define BENCH_NBPTRS 256
+
+static unsigned long
+bench_findregion_worker (unsigned ix)
+{
+  void *ptrs[BENCH_NBPTRS];
+  (void) ix;
+  for (unsigned j = 0; j < BENCH_NBPTRS; j++)
+    ptrs[j] = yaca_work_allocate (2 * sizeof (void *));
+  for (unsigned long n = 0; n < BENCH_NBLOOKUPS; n++)
+    if (YACA_UNLIKELY (!yaca_find_region (ptrs[n % BENCH_NBPTRS])))
+      YACA_FATAL ("no region for %p", ptrs[n % BENCH_NBPTRS]);
+  return BENCH_NBLOOKUPS;
+}
+
+void
+bench_findregion (void)
+{
+  bench_on_workers ("find region", bench_findregion_worker);
+}
+
+/* eof yacasys/bench/findregion.c */
@@ -0,0 +1,182 @@
+/** file yacasys/bench/gcpause.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** The pauses of the collector, in stop-the-world then in concurrent
+   mode, with a large live graph to mark. The graph is a tree of node
+   items, each keeping the tuple of its children, under a root per
+   worker. Stamped tasks are added by small batches; each of them
+   replaces the tuple of a random node by a copy, thru the write
+   barrier, and allocates some garbage region data, so that the pacer
+   asks for collections. For each mode, the pauses of its collections
+   and the latency of the tasks, from their adding to their run, are
+   printed. **/
+
+#define BENCH_NBNODES 131072	/* live nodes made by each worker */
+#define BENCH_NBCHILDREN 4	/* children of an inner node */
+#define BENCH_NBROUNDS 2000	/* batches of tasks in each mode */
+#define BENCH_BATCH 64		/* stamped tasks in each batch */
+#define BENCH_GARBAGE 4096	/* bytes of garbage made by each task */
+#define BENCH_NBRECORDS 128	/* at most the collections kept in telemetry */
+
+static struct
+{
+  struct yaca_item_st **nodes;
+  unsigned long nbnodes;
+  double *latencies;
+  unsigned long nblatencies;	/* atomically incremented */
+} gcpause;
+
+static void
+bench_node_gcscan (struct yaca_item_st *itm)
+{
+  struct yaca_tupleitems_st *tup =
+    (struct yaca_tupleitems_st *) itm->itm_dataspace[0];
+  itm->itm_dataspace[0] = (long) yaca_tuple_gcscan (tup);
+}
+
+static struct yaca_itemtype_st bench_node_type = {
+  .typ_magic = YACA_TYPE_MAGIC,.typ_num = btyp_node,
+  .typ_name = "bench_node",.typr_gcscan = bench_node_gcscan
+};
+
+// make the tree of a worker bottom up, from its last node to its root,
+// the children of the node n being the nodes 4n+1 to 4n+4
+static unsigned long
+bench_gcpause_build (unsigned ix)
+{
+  struct yaca_item_st **nodes = gcpause.nodes + ix * BENCH_NBNODES;
+  for (long n = BENCH_NBNODES - 1; n >= 0; n--)
+    {
+      struct yaca_item_st *children[BENCH_NBCHILDREN];
+      unsigned nbchildren = 0;
+      for (unsigned c = 1; c <= BENCH_NBCHILDREN; c++)
+	if (BENCH_NBCHILDREN * n + c < BENCH_NBNODES)
+	  children[nbchildren++] = nodes[BENCH_NBCHILDREN * n + c];
+      struct yaca_item_st *node =
+	yaca_item_make (btyp_node, (n == 0) ? BENCH_SPACE : 0, sizeof (long));
+      if (nbchildren > 0)
+	node->itm_dataspace[0] = (long) yaca_tuple_make (nbchildren, children);
+      nodes[n] = node;
+    }
+  return BENCH_NBNODES;
+}
+
+static void
+bench_gcpause_task (struct yaca_item_st *itm)
+{
+  double stamp;
+  memcpy (&stamp, itm->itm_dataspace, sizeof (stamp));
+  unsigned long ix = __atomic_fetch_add (&gcpause.nblatencies, 1,
+					 __ATOMIC_RELAXED);
+  gcpause.latencies[ix] = bench_clock () - stamp;
+  struct yaca_item_st *node = gcpause.nodes[(ix * 2654435761UL)
+					    % gcpause.nbnodes];
+  yaca_item_lock (node);
+  yaca_item_touch (node);
+  struct yaca_tupleitems_st *tup =
+    (struct yaca_tupleitems_st *) node->itm_dataspace[0];
+  if (tup)
+    node->itm_dataspace[0] =
+      (long) yaca_tuple_make (tup->tup_len, tup->tup_items);
+  yaca_item_unlock (node);
+  memset (yaca_work_allocate (BENCH_GARBAGE), 1, BENCH_GARBAGE);
+}
+
+// print the pauses of the collections after the given one
+static void
+bench_print_pauses (const char *title, unsigned long firstgc)
+{
+  double pauses[BENCH_NBRECORDS];
+  unsigned nbpauses = 0;
+  json_t *jtel = yaca_gc_telemetry_json ();
+  json_t *jrecords = json_object_get (jtel, "records");
+  for (unsigned rix = 0; rix < BENCH_NBRECORDS; rix++)
+    {
+      json_t *jrec = json_array_get (jrecords, rix);
+      if (!jrec)
+	break;
+      if ((unsigned long)
+	  json_integer_value (json_object_get (jrec, "num")) > firstgc)
+	pauses[nbpauses++] =
+	  json_number_value (json_object_get (jrec, "pause"));
+    }
+  json_decref (jtel);
+  if (nbpauses == 0)
+    {
+      printf ("%-24s no collection\n", title);
+      return;
+    }
+  qsort (pauses, nbpauses, sizeof (double), bench_cmp_double);
+  printf ("%-24s %9.1f us median, %.1f us p99, %.1f us max,"
+	  " %u collections\n", title, 1.0e6 * pauses[nbpauses / 2],
+	  1.0e6 * pauses[nbpauses * 99 / 100], 1.0e6 * pauses[nbpauses - 1],
+	  nbpauses);
+}
+
+static void
+bench_gcpause_run (enum yaca_gcmode_en mode, const char *pausetitle,
+		   const char *latencytitle)
+{
+  struct yaca_item_st **tasks = bench_task_items (BENCH_BATCH);
+  enum yaca_gcmode_en oldmode = yaca_gc_mode;
+  // no collection should run when the mode changes
+  bench_gc_quiesce ();
+  yaca_gc_mode = mode;
+  unsigned long firstgc = bench_gc_collections ();
+  gcpause.nblatencies = 0;
+  bench_task_hook = bench_gcpause_task;
+  for (unsigned r = 0; r < BENCH_NBROUNDS; r++)
+    {
+      double stamp = bench_clock ();
+      for (unsigned n = 0; n < BENCH_BATCH; n++)
+	memcpy (tasks[n]->itm_dataspace, &stamp, sizeof (stamp));
+      bench_tasks_expect (BENCH_BATCH);
+      yaca_agenda_add_batch (tasks, BENCH_BATCH, tkprio_normal);
+      bench_tasks_wait ();
+    }
+  bench_task_hook = NULL;
+  bench_gc_quiesce ();
+  yaca_gc_mode = oldmode;
+  bench_print_pauses (pausetitle, firstgc);
+  bench_print_latencies (latencytitle, gcpause.latencies,
+			 gcpause.nblatencies);
+}
+
+void
+bench_gcpause (void)
+{
+  bench_add_type (&bench_node_type);
+  gcpause.nbnodes = (unsigned long) bench_nbworkers * BENCH_NBNODES;
+  gcpause.nodes = calloc (gcpause.nbnodes, sizeof (struct yaca_item_st *));
+  gcpause.latencies = calloc (BENCH_NBROUNDS * BENCH_BATCH, sizeof (double));
+  if (!gcpause.nodes || !gcpause.latencies)
+    YACA_FATAL ("out of memory for the gc pause bench");
+  bench_on_workers ("live node make", bench_gcpause_build);
+  bench_gcpause_run (yagc_stoptheworld, "stop-the-world pause",
+		     "stop-the-world latency");
+  bench_gcpause_run (yagc_concurrent, "concurrent pause",
+		     "concurrent latency");
+}
+
+/* eof yacasys/bench/gcpause.c */
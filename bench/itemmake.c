@@ -0,0 +1,47 @@
+/** file yacasys/bench/itemmake.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** Making items from every worker at once, in the slabs of their
+   size class. They are not reachable, so the next collection sweeps
+   them. **/
+
+#define BENCH_NBITEMS 262144	/* items made by each worker */
+
+static unsigned long
+bench_itemmake_worker (unsigned ix)
+{
+  (void) ix;
+  for (unsigned long n = 0; n < BENCH_NBITEMS; n++)
+    if (YACA_UNLIKELY (!yaca_item_make (btyp_task, 0, 0)))
+      YACA_FATAL ("failed to make item");
+  return BENCH_NBITEMS;
+}
+
+void
+bench_itemmake (void)
+{
+  bench_on_workers ("item make", bench_itemmake_worker);
+}
+
+/* eof yacasys/bench/itemmake.c */
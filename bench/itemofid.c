@@ -0,0 +1,60 @@
+/** file yacasys/bench/itemofid.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** Finding items by their id from every worker at once, which never
+   locks. The ids are those of the task items, picked at random. **/
+
+#define BENCH_NBITEMS 1000000	/* items to find */
+#define BENCH_NBLOOKUPS 2000000	/* lookups by each worker */
+
+static yaca_id_t *bench_ids;
+
+static unsigned long
+bench_itemofid_worker (unsigned ix)
+{
+  unsigned seed = ix + 1;
+  for (unsigned long n = 0; n < BENCH_NBLOOKUPS; n++)
+    {
+      yaca_id_t id = bench_ids[rand_r (&seed) % BENCH_NBITEMS];
+      if (YACA_UNLIKELY (yaca_item_of_id (id) == NULL))
+	YACA_FATAL ("lost item #%ld", (long) id);
+    }
+  return BENCH_NBLOOKUPS;
+}
+
+void
+bench_itemofid (void)
+{
+  struct yaca_item_st **items = bench_task_items (BENCH_NBITEMS);
+  bench_ids = calloc (BENCH_NBITEMS, sizeof (yaca_id_t));
+  if (!bench_ids)
+    YACA_FATAL ("out of memory for bench ids");
+  for (unsigned long n = 0; n < BENCH_NBITEMS; n++)
+    bench_ids[n] = items[n]->itm_id;
+  bench_on_workers ("item of id", bench_itemofid_worker);
+  free (bench_ids);
+  bench_ids = NULL;
+}
+
+/* eof yacasys/bench/itemofid.c */
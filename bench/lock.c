@@ -0,0 +1,76 @@
+/** file yacasys/bench/lock.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** Locking and unlocking items, with the compact lock word: first
+   items of its own in each worker, then a single item shared by all
+   the workers. **/
+
+#define BENCH_NBITEMS 4096	/* items locked by each worker */
+#define BENCH_NBLOCKS 2000000	/* uncontended locks by each worker */
+#define BENCH_NBCONTENDED 200000	/* locks of the shared item */
+
+static struct yaca_item_st **bench_lockitems;
+static struct yaca_item_st *bench_shared;
+
+static unsigned long
+bench_lock_worker (unsigned ix)
+{
+  struct yaca_item_st **items = bench_lockitems + ix * BENCH_NBITEMS;
+  for (unsigned long n = 0; n < BENCH_NBLOCKS; n++)
+    {
+      struct yaca_item_st *itm = items[n % BENCH_NBITEMS];
+      yaca_item_lock (itm);
+      yaca_item_unlock (itm);
+    }
+  return BENCH_NBLOCKS;
+}
+
+static unsigned long
+bench_contended_worker (unsigned ix)
+{
+  (void) ix;
+  for (unsigned long n = 0; n < BENCH_NBCONTENDED; n++)
+    {
+      yaca_item_lock (bench_shared);
+      bench_shared->itm_dataspace[0]++;
+      yaca_item_unlock (bench_shared);
+    }
+  return BENCH_NBCONTENDED;
+}
+
+void
+bench_lock (void)
+{
+  bench_lockitems = bench_task_items (bench_nbworkers * BENCH_NBITEMS);
+  bench_shared = yaca_item_make (btyp_task, BENCH_SPACE, sizeof (long));
+  bench_on_workers ("item lock & unlock", bench_lock_worker);
+  bench_on_workers ("contended lock & unlock", bench_contended_worker);
+  if (bench_shared->itm_dataspace[0]
+      != (long) bench_nbworkers * BENCH_NBCONTENDED)
+    YACA_FATAL ("lost %ld contended increments",
+		(long) bench_nbworkers * BENCH_NBCONTENDED
+		- bench_shared->itm_dataspace[0]);
+}
+
+/* eof yacasys/bench/lock.c */
@@ -0,0 +1,107 @@
+/** file yacasys/bench/rehash.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** The latency of adding then removing many pending tasks, which grows
+   then shrinks the agenda queues. The workers are kept blocked
+   meanwhile, each in a task of its own, so that every added task stays
+   queued; the tail of each latency shows the spikes of resizing. **/
+
+#define BENCH_NBTASKS 1048576	/* tasks queued at once */
+
+static struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct yaca_item_st *blockers[YACA_MAX_WORKERS];
+  unsigned nbblocked;
+  bool released;
+  double *latencies;
+} rehash = {
+.mutex = PTHREAD_MUTEX_INITIALIZER,.cond = PTHREAD_COND_INITIALIZER};
+
+// block in the task of a blocker item, till released
+static void
+bench_rehash_task (struct yaca_item_st *itm)
+{
+  unsigned ix = 0;
+  while (ix < bench_nbworkers && rehash.blockers[ix] != itm)
+    ix++;
+  if (ix >= bench_nbworkers)
+    YACA_FATAL ("task #%ld run while the workers are blocked",
+		(long) itm->itm_id);
+  pthread_mutex_lock (&rehash.mutex);
+  rehash.nbblocked++;
+  pthread_cond_broadcast (&rehash.cond);
+  while (!rehash.released)
+    pthread_cond_wait (&rehash.cond, &rehash.mutex);
+  pthread_mutex_unlock (&rehash.mutex);
+}
+
+void
+bench_rehash (void)
+{
+  struct yaca_item_st **tasks = bench_task_items (BENCH_NBTASKS);
+  rehash.latencies = calloc (BENCH_NBTASKS, sizeof (double));
+  if (!rehash.latencies)
+    YACA_FATAL ("out of memory for the rehash latencies");
+  for (unsigned ix = 0; ix < bench_nbworkers; ix++)
+    rehash.blockers[ix] =
+      yaca_item_make (btyp_task, BENCH_SPACE, sizeof (double));
+  rehash.nbblocked = 0;
+  rehash.released = false;
+  bench_task_hook = bench_rehash_task;
+  bench_tasks_expect (bench_nbworkers);
+  yaca_agenda_add_batch (rehash.blockers, bench_nbworkers, tkprio_high);
+  pthread_mutex_lock (&rehash.mutex);
+  while (rehash.nbblocked < bench_nbworkers)
+    pthread_cond_wait (&rehash.cond, &rehash.mutex);
+  pthread_mutex_unlock (&rehash.mutex);
+  for (unsigned long n = 0; n < BENCH_NBTASKS; n++)
+    {
+      double start = bench_clock ();
+      if (YACA_UNLIKELY (!yaca_agenda_add_back (tasks[n], tkprio_normal)))
+	YACA_FATAL ("failed to add task #%ld", (long) tasks[n]->itm_id);
+      rehash.latencies[n] = bench_clock () - start;
+    }
+  bench_print_latencies ("agenda add, 1M queued", rehash.latencies,
+			 BENCH_NBTASKS);
+  for (unsigned long n = 0; n < BENCH_NBTASKS; n++)
+    {
+      double start = bench_clock ();
+      if (YACA_UNLIKELY (yaca_agenda_remove (tasks[n]) == tkprio__none))
+	YACA_FATAL ("failed to remove task #%ld", (long) tasks[n]->itm_id);
+      rehash.latencies[n] = bench_clock () - start;
+    }
+  bench_print_latencies ("agenda remove", rehash.latencies, BENCH_NBTASKS);
+  pthread_mutex_lock (&rehash.mutex);
+  rehash.released = true;
+  pthread_cond_broadcast (&rehash.cond);
+  pthread_mutex_unlock (&rehash.mutex);
+  bench_tasks_wait ();
+  bench_task_hook = NULL;
+  free (rehash.latencies);
+  rehash.latencies = NULL;
+}
+
+/* eof yacasys/bench/rehash.c */
@@ -0,0 +1,80 @@
+/** file yacasys/bench/seqread.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** Optimistic reads of a seqlocked item by all the workers but the
+   first, which writes it now and then under its lock. Its two fields
+   should always be read with a zero sum. **/
+
+#define BENCH_NBREADS 2000000	/* reads by each worker */
+#define BENCH_WRITEPERIOD 64	/* reads of a worker per write */
+
+static struct yaca_item_st *bench_seqitem;
+
+static struct yaca_itemtype_st bench_seqlocked_type = {
+  .typ_magic = YACA_TYPE_MAGIC,.typ_num = btyp_seqlocked,
+  .typ_name = "bench_seqlocked",.typ_flags = YACA_TYPEFLAG_SEQLOCK
+};
+
+static unsigned long
+bench_seqread_worker (unsigned ix)
+{
+  struct yaca_item_st *seqitm = bench_seqitem;
+  if (ix == 0)
+    {
+      for (unsigned long n = 0; n < BENCH_NBREADS; n += BENCH_WRITEPERIOD)
+	{
+	  yaca_item_lock (seqitm);
+	  seqitm->itm_dataspace[0]++;
+	  seqitm->itm_dataspace[1]--;
+	  yaca_item_unlock (seqitm);
+	}
+      return 0;
+    }
+  for (unsigned long n = 0; n < BENCH_NBREADS; n++)
+    {
+      long v0 = 0, v1 = 0;
+      uint32_t seq;
+      do
+	{
+	  seq = yaca_item_read_begin (seqitm);
+	  v0 = seqitm->itm_dataspace[0];
+	  v1 = seqitm->itm_dataspace[1];
+	}
+      while (yaca_item_read_retry (seqitm, seq));
+      if (YACA_UNLIKELY (v0 + v1 != 0))
+	YACA_FATAL ("torn seqlock read %ld %ld", v0, v1);
+    }
+  return BENCH_NBREADS;
+}
+
+void
+bench_seqread (void)
+{
+  bench_add_type (&bench_seqlocked_type);
+  bench_seqitem = yaca_item_make (btyp_seqlocked, BENCH_SPACE,
+				  2 * sizeof (long));
+  bench_on_workers ("seqlock read", bench_seqread_worker);
+}
+
+/* eof yacasys/bench/seqread.c */
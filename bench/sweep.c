@@ -0,0 +1,69 @@
+/** file yacasys/bench/sweep.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** The sweep of many unreached items by a collection, the marks being
+   in a bitmap per slab. The pause of that collection is given for a
+   million swept items. **/
+
+#define BENCH_NBGARBAGE 1000000	/* unreached items made in all */
+
+static unsigned long
+bench_sweep_worker (unsigned ix)
+{
+  unsigned long nb = BENCH_NBGARBAGE / bench_nbworkers;
+  (void) ix;
+  for (unsigned long n = 0; n < nb; n++)
+    yaca_item_make (btyp_task, 0, 0);
+  return nb;
+}
+
+void
+bench_sweep (void)
+{
+  bench_gc_quiesce ();
+  bench_on_workers ("garbage item make", bench_sweep_worker);
+  bench_gc_quiesce ();
+  // the last record is that of the collection which swept them
+  double pause = 0.0;
+  unsigned long swept = 0, lastnum = 0;
+  json_t *jtel = yaca_gc_telemetry_json ();
+  json_t *jrec = NULL;
+  for (unsigned rix = 0;
+       (jrec = json_array_get (json_object_get (jtel, "records"), rix))
+       != NULL; rix++)
+    {
+      unsigned long num = json_integer_value (json_object_get (jrec, "num"));
+      if (num < lastnum)
+	continue;
+      lastnum = num;
+      pause = json_number_value (json_object_get (jrec, "pause"));
+      swept = json_integer_value (json_object_get (jrec, "swept"));
+    }
+  json_decref (jtel);
+  printf ("%-24s %9.1f us pause, %.1f us per million, %lu swept\n",
+	  "sweep", 1.0e6 * pause, swept ? 1.0e12 * pause / swept : 0.0,
+	  swept);
+}
+
+/* eof yacasys/bench/sweep.c */
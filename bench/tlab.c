@@ -0,0 +1,79 @@
+/** file yacasys/bench/tlab.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** Small work allocations, from every worker at once, then from this
+   thread, which is not a worker so allocates in its thread-local
+   buffer. Both should rarely take a mutex, only to get a region; the
+   allocations taking one are counted by yaca_alloc_stats. **/
+
+#define BENCH_NBALLOCS 2000000	/* allocations in each loop */
+#define BENCH_ALLOCSIZE 48	/* bytes of each */
+#define BENCH_SAFEPOINT 4096	/* allocations between safepoints */
+
+static unsigned long
+bench_tlab_worker (unsigned ix)
+{
+  (void) ix;
+  for (unsigned long n = 0; n < BENCH_NBALLOCS; n++)
+    if (YACA_UNLIKELY (!yaca_work_allocate (BENCH_ALLOCSIZE)))
+      YACA_FATAL ("failed to allocate %d bytes", BENCH_ALLOCSIZE);
+  return BENCH_NBALLOCS;
+}
+
+static void
+bench_print_locked (const char *title, struct yaca_alloc_stats_st *before)
+{
+  struct yaca_alloc_stats_st after;
+  yaca_alloc_stats (&after);
+  unsigned long nballocs = after.als_allocations - before->als_allocations;
+  unsigned long nblocked = after.als_locked - before->als_locked;
+  printf ("%-24s %9.3f locked per 1000, %lu of %lu allocations\n", title,
+	  nballocs ? 1000.0 * nblocked / nballocs : 0.0, nblocked, nballocs);
+}
+
+void
+bench_tlab (void)
+{
+  struct yaca_alloc_stats_st before;
+  yaca_alloc_stats (&before);
+  bench_on_workers ("worker allocation", bench_tlab_worker);
+  bench_print_locked ("worker allocation locks", &before);
+  yaca_alloc_stats (&before);
+  double start = bench_clock ();
+  for (unsigned long n = 0; n < BENCH_NBALLOCS; n++)
+    {
+      if (YACA_UNLIKELY (!yaca_work_allocate (BENCH_ALLOCSIZE)))
+	YACA_FATAL ("failed to allocate %d bytes", BENCH_ALLOCSIZE);
+      if (n % BENCH_SAFEPOINT == BENCH_SAFEPOINT - 1)
+	yaca_work_safepoint ();
+    }
+  yaca_work_safepoint ();
+  double elapsed = bench_clock () - start;
+  printf ("%-24s %9.1f ns/op %7.2f Mop/s in %.3f s\n",
+	  "non-worker allocation", 1.0e9 * elapsed / BENCH_NBALLOCS,
+	  1.0e-6 * BENCH_NBALLOCS / elapsed, elapsed);
+  bench_print_locked ("non-worker alloc locks", &before);
+}
+
+/* eof yacasys/bench/tlab.c */
@@ -0,0 +1,68 @@
+/** file yacasys/bench/typenum.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** Enumerating the few items of a rare type among many, thru the index
+   of their type, then by scanning every item. Both should find the
+   same items. **/
+
+#define BENCH_NBRARE 1000	/* items of the rare type */
+#define BENCH_SCANBLOCK 4096	/* ids scanned at once */
+
+static struct yaca_itemtype_st bench_rare_type = {
+  .typ_magic = YACA_TYPE_MAGIC,.typ_num = btyp_rare,
+  .typ_name = "bench_rare"
+};
+
+void
+bench_typenum (void)
+{
+  bench_add_type (&bench_rare_type);
+  for (unsigned n = 0; n < BENCH_NBRARE; n++)
+    yaca_item_make (btyp_rare, BENCH_SPACE, 0);
+  double start = bench_clock ();
+  unsigned long nbrare = yaca_items_of_type (btyp_rare, NULL, NULL);
+  double indexed = bench_clock () - start;
+  yaca_id_t bound = yaca_items_bound ();
+  struct yaca_item_st **buf =
+    calloc (BENCH_SCANBLOCK, sizeof (struct yaca_item_st *));
+  if (!buf)
+    YACA_FATAL ("out of memory for the scan buffer");
+  unsigned long nbscanned = 0;
+  start = bench_clock ();
+  for (yaca_id_t lo = 1; lo < bound; lo += BENCH_SCANBLOCK)
+    {
+      unsigned nb = yaca_items_in_range (lo, lo + BENCH_SCANBLOCK, buf);
+      for (unsigned ix = 0; ix < nb; ix++)
+	nbscanned += buf[ix]->itm_typnum == btyp_rare;
+    }
+  double scanned = bench_clock () - start;
+  free (buf);
+  printf ("%-24s %9.1f us indexed, %.1f us scanned, %lu of %ld items\n",
+	  "type enumeration", 1.0e6 * indexed, 1.0e6 * scanned, nbrare,
+	  (long) bound);
+  if (nbrare != nbscanned)
+    YACA_FATAL ("index gave %lu items, scan %lu", nbrare, nbscanned);
+}
+
+/* eof yacasys/bench/typenum.c */
@@ -0,0 +1,62 @@
+/** file yacasys/bench/wake.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** The latency of starting a task when the workers are idle, from its
+   adding by this thread to its run by a woken worker. **/
+
+#define BENCH_NBWAKES 1000	/* latency samples */
+#define BENCH_IDLEMICROS 1000	/* idle time before each sample */
+
+static double bench_wakelatency[BENCH_NBWAKES];
+static unsigned long bench_nbwakes;
+
+static void
+bench_wake_task (struct yaca_item_st *itm)
+{
+  double stamp;
+  memcpy (&stamp, itm->itm_dataspace, sizeof (stamp));
+  bench_wakelatency[bench_nbwakes++] = bench_clock () - stamp;
+}
+
+void
+bench_wake (void)
+{
+  struct yaca_item_st *task = bench_task_items (1)[0];
+  bench_nbwakes = 0;
+  bench_task_hook = bench_wake_task;
+  for (unsigned n = 0; n < BENCH_NBWAKES; n++)
+    {
+      usleep (BENCH_IDLEMICROS);
+      double stamp = bench_clock ();
+      memcpy (task->itm_dataspace, &stamp, sizeof (stamp));
+      bench_tasks_expect (1);
+      yaca_agenda_add_back (task, tkprio_normal);
+      bench_tasks_wait ();
+    }
+  bench_task_hook = NULL;
+  bench_print_latencies ("idle wake latency", bench_wakelatency,
+			 bench_nbwakes);
+}
+
+/* eof yacasys/bench/wake.c */
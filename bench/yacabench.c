@@ -0,0 +1,290 @@
+/** file yacasys/bench/yacabench.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yacabench.h"
+
+/** A small benchmark driver, built by "make bench". It initializes
+   the system thru the real main, compiled as yaca_main, so accepts
+   the same options (e.g. -w 8 -G concurrent), starts the agenda, and
+   runs the benchmarks of its table, or only those named in the comma
+   separated YACABENCH environment variable. The measured items are in
+   a space of their own, so they are roots and stay alive. **/
+
+// the spaces are otherwise defined with the persistent store
+struct yaca_space_st *yaca_spacetab[YACA_MAX_SPACE];
+
+static const struct bench_entry_st
+{
+  const char *be_name;
+  bench_sig_t *be_fun;
+} bench_table[] =
+{
+  {"findregion", bench_findregion},
+  {"gcpause", bench_gcpause},
+  {"tlab", bench_tlab},
+  {"itemmake", bench_itemmake},
+  {"itemofid", bench_itemofid},
+  {"sweep", bench_sweep},
+  {"lock", bench_lock},
+  {"seqread", bench_seqread},
+  {"typenum", bench_typenum},
+  {"fanout", bench_fanout},
+  {"batches", bench_batches},
+  {"rehash", bench_rehash},
+  {"dequegrow", bench_dequegrow},
+  {"wake", bench_wake},
+  {NULL, NULL}
+};
+
+unsigned bench_nbworkers;
+void (*bench_task_hook) (struct yaca_item_st *);
+
+static struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  bench_worker_sig_t *workfun;
+  unsigned nbdone;		/* measuring tasks done */
+  double elapsed[YACA_MAX_WORKERS];	/* seconds, of each task */
+  unsigned long nbops[YACA_MAX_WORKERS];
+  struct yaca_item_st *workitems[YACA_MAX_WORKERS];
+  struct yaca_item_st **tasks;
+  unsigned long nbtasks;
+  unsigned long nbtasksrun;	/* atomically incremented */
+  unsigned long nbtaskswanted;
+} bench = {
+.mutex = PTHREAD_MUTEX_INITIALIZER,.cond = PTHREAD_COND_INITIALIZER};
+
+double
+bench_clock (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+int
+bench_cmp_double (const void *p1, const void *p2)
+{
+  double d1 = *(const double *) p1, d2 = *(const double *) p2;
+  return (d1 < d2) ? -1 : (d1 > d2);
+}
+
+void
+bench_add_type (struct yaca_itemtype_st *typ)
+{
+  assert (typ && typ->typ_magic == YACA_TYPE_MAGIC);
+  assert (typ->typ_num > 0 && typ->typ_num < btyp__last);
+  yaca_typetab[typ->typ_num] = typ;
+}
+
+// the run routine of the measuring tasks
+static void
+bench_run_worker (struct yaca_item_st *itm)
+{
+  unsigned ix = (unsigned) itm->itm_dataspace[0];
+  assert (ix < bench_nbworkers);
+  double start = bench_clock ();
+  unsigned long nbops = (*bench.workfun) (ix);
+  double end = bench_clock ();
+  pthread_mutex_lock (&bench.mutex);
+  bench.elapsed[ix] = end - start;
+  bench.nbops[ix] = nbops;
+  bench.nbdone++;
+  pthread_cond_broadcast (&bench.cond);
+  pthread_mutex_unlock (&bench.mutex);
+}
+
+void
+bench_on_workers (const char *title, bench_worker_sig_t *fun)
+{
+  double totelapsed = 0.0;
+  unsigned long totops = 0;
+  pthread_mutex_lock (&bench.mutex);
+  bench.workfun = fun;
+  bench.nbdone = 0;
+  pthread_mutex_unlock (&bench.mutex);
+  double start = bench_clock ();
+  yaca_agenda_add_batch (bench.workitems, bench_nbworkers, tkprio_high);
+  pthread_mutex_lock (&bench.mutex);
+  while (bench.nbdone < bench_nbworkers)
+    pthread_cond_wait (&bench.cond, &bench.mutex);
+  pthread_mutex_unlock (&bench.mutex);
+  double wall = bench_clock () - start;
+  for (unsigned ix = 0; ix < bench_nbworkers; ix++)
+    {
+      totelapsed += bench.elapsed[ix];
+      totops += bench.nbops[ix];
+    }
+  if (totops == 0)
+    totops = 1;
+  printf ("%-24s %9.1f ns/op %7.2f Mop/s in %.3f s\n", title,
+	  1.0e9 * totelapsed / totops, 1.0e-6 * totops / wall, wall);
+}
+
+// the run routine of the task items
+static void
+bench_run_task (struct yaca_item_st *itm)
+{
+  if (bench_task_hook)
+    (*bench_task_hook) (itm);
+  if (__atomic_add_fetch (&bench.nbtasksrun, 1, __ATOMIC_ACQ_REL)
+      == __atomic_load_n (&bench.nbtaskswanted, __ATOMIC_ACQUIRE))
+    {
+      pthread_mutex_lock (&bench.mutex);
+      pthread_cond_broadcast (&bench.cond);
+      pthread_mutex_unlock (&bench.mutex);
+    }
+}
+
+struct yaca_item_st **
+bench_task_items (unsigned long nb)
+{
+  if (nb > bench.nbtasks)
+    {
+      struct yaca_item_st **tasks =
+	realloc (bench.tasks, nb * sizeof (struct yaca_item_st *));
+      if (!tasks)
+	YACA_FATAL ("out of memory for %lu bench tasks", nb);
+      for (unsigned long n = bench.nbtasks; n < nb; n++)
+	tasks[n] = yaca_item_make (btyp_task, BENCH_SPACE, sizeof (double));
+      bench.tasks = tasks;
+      bench.nbtasks = nb;
+    }
+  return bench.tasks;
+}
+
+void
+bench_tasks_expect (unsigned long nb)
+{
+  __atomic_store_n (&bench.nbtasksrun, 0, __ATOMIC_RELEASE);
+  __atomic_store_n (&bench.nbtaskswanted, nb, __ATOMIC_RELEASE);
+}
+
+void
+bench_tasks_wait (void)
+{
+  pthread_mutex_lock (&bench.mutex);
+  while (__atomic_load_n (&bench.nbtasksrun, __ATOMIC_ACQUIRE)
+	 < bench.nbtaskswanted)
+    pthread_cond_wait (&bench.cond, &bench.mutex);
+  pthread_mutex_unlock (&bench.mutex);
+}
+
+void
+bench_print_latencies (const char *title, double *samples, unsigned long nb)
+{
+  if (nb == 0)
+    return;
+  qsort (samples, nb, sizeof (double), bench_cmp_double);
+  printf ("%-24s %9.1f us median, %.1f us p99, %.1f us p99.99,"
+	  " %.1f us max\n", title, 1.0e6 * samples[nb / 2],
+	  1.0e6 * samples[nb * 99 / 100], 1.0e6 * samples[nb * 9999 / 10000],
+	  1.0e6 * samples[nb - 1]);
+}
+
+unsigned long
+bench_gc_collections (void)
+{
+  json_t *jtel = yaca_gc_telemetry_json ();
+  unsigned long nbgc =
+    json_integer_value (json_object_get (jtel, "collections"));
+  json_decref (jtel);
+  return nbgc;
+}
+
+void
+bench_gc_quiesce (void)
+{
+  unsigned long nbgc = bench_gc_collections ();
+  yaca_should_garbage_collect ();
+  for (unsigned n = 0; bench_gc_collections () <= nbgc; n++)
+    {
+      if (n > 10000)
+	YACA_FATAL ("no collection in 10 seconds");
+      usleep (1000);
+    }
+}
+
+static struct yaca_itemtype_st bench_worker_type = {
+  .typ_magic = YACA_TYPE_MAGIC,.typ_num = btyp_worker,
+  .typ_name = "bench_worker",.typr_runitem = bench_run_worker
+};
+
+static struct yaca_itemtype_st bench_task_type = {
+  .typ_magic = YACA_TYPE_MAGIC,.typ_num = btyp_task,
+  .typ_name = "bench_task",.typr_runitem = bench_run_task
+};
+
+static struct yaca_space_st bench_space = {
+  .spa_magic = YACA_SPACE_MAGIC,.spa_num = BENCH_SPACE,.spa_name = "bench"
+};
+
+// is some benchmark selected by the YACABENCH variable
+static bool
+bench_selected (const char *name)
+{
+  const char *sel = getenv ("YACABENCH");
+  size_t len = strlen (name);
+  if (!sel || !sel[0])
+    return true;
+  for (const char *pc = sel; (pc = strstr (pc, name)) != NULL; pc += len)
+    if ((pc == sel || pc[-1] == ',') && (pc[len] == ',' || !pc[len]))
+      return true;
+  return false;
+}
+
+int
+main (int argc, char **argv)
+{
+  bench_add_type (&bench_worker_type);
+  bench_add_type (&bench_task_type);
+  yaca_spacetab[BENCH_SPACE] = &bench_space;
+  yaca_main (argc, argv);
+  yaca_start_agenda ();
+  bench_nbworkers = yaca_nb_workers;
+  printf ("yacabench with %u workers, built %s\n", bench_nbworkers,
+	  yaca_build_timestamp);
+  for (unsigned ix = 0; ix < bench_nbworkers; ix++)
+    {
+      bench.workitems[ix] =
+	yaca_item_make (btyp_worker, BENCH_SPACE, sizeof (long));
+      bench.workitems[ix]->itm_dataspace[0] = ix;
+    }
+  for (const struct bench_entry_st * be = bench_table; be->be_name; be++)
+    if (bench_selected (be->be_name))
+      {
+	(*be->be_fun) ();
+	fflush (stdout);
+      }
+  {
+    json_t *jtel = yaca_gc_telemetry_json ();
+    char *str = json_dumps (jtel, JSON_COMPACT);
+    printf ("gc telemetry %s\n", str ? str : "?");
+    free (str);
+    json_decref (jtel);
+  }
+  yaca_agenda_stop ();
+  return 0;
+}
+
+/* eof yacasys/bench/yacabench.c */
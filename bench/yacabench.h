@@ -0,0 +1,98 @@
+/** file yacasys/bench/yacabench.h
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+#ifndef YACABENCH_INCLUDED
+#define YACABENCH_INCLUDED
+
+#include "yaca.h"
+
+/** The benchmarks are run by the driver in yacabench.c, in the order
+   of its table, each from its own file. **/
+
+int yaca_main (int argc, char **argv);
+
+// the item types of the benchmarks
+enum bench_type_en
+{
+  btyp__none,
+  btyp_worker,			/* measuring tasks, one per worker */
+  btyp_task,			/* tiny tasks, see bench_task_items */
+  btyp_node,			/* live graph of the gc pause bench */
+  btyp_seqlocked,		/* read optimistically */
+  btyp_rare,			/* a few items, to enumerate */
+  btyp__last
+};
+
+// the items of that space are roots, so stay alive
+#define BENCH_SPACE 1
+
+// a benchmark, run by the main thread with the agenda started
+typedef void bench_sig_t (void);
+
+// a measuring routine, run as a task on each worker, given the index
+// of that task; it gives its number of operations
+typedef unsigned long bench_worker_sig_t (unsigned ix);
+
+extern unsigned bench_nbworkers;
+
+double bench_clock (void);
+int bench_cmp_double (const void *p1, const void *p2);
+
+// register the type of some benchmark items, before making them
+void bench_add_type (struct yaca_itemtype_st *typ);
+
+// run a measuring routine on every worker at once, and print the mean
+// time of its operations
+void bench_on_workers (const char *title, bench_worker_sig_t *fun);
+
+// give at least nb task items, made once and kept alive; when run,
+// they call the task hook if any, then count as run
+struct yaca_item_st **bench_task_items (unsigned long nb);
+extern void (*bench_task_hook) (struct yaca_item_st *);
+// expect some task items to be run, then wait till they are
+void bench_tasks_expect (unsigned long nb);
+void bench_tasks_wait (void);
+
+// the number of collections, and ask for one then wait for its end
+unsigned long bench_gc_collections (void);
+void bench_gc_quiesce (void);
+
+// sort samples in seconds, and print their median, tail and maximum
+void bench_print_latencies (const char *title, double *samples,
+			    unsigned long nb);
+
+// the benchmarks, each in its own file
+void bench_findregion (void);
+void bench_gcpause (void);
+void bench_tlab (void);
+void bench_itemmake (void);
+void bench_itemofid (void);
+void bench_sweep (void);
+void bench_lock (void);
+void bench_seqread (void);
+void bench_typenum (void);
+void bench_fanout (void);
+void bench_batches (void);
+void bench_rehash (void);
+void bench_dequegrow (void);
+void bench_wake (void);
+
+#endif /*YACABENCH_INCLUDED */
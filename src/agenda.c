@@ -49,39 +49,299 @@ struct yaca_worker_st yaca_worktab[YACA_MAX_WORKERS + 1];
 static pthread_mutex_t yaca_agenda_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t yaca_agendachanged_cond = PTHREAD_COND_INITIALIZER;
 
-typedef int32_t yaca_agindex_t;
-
-#define YACA_AGENTRY_MAGIC 1049484667	/*0x3e8ddd7b */
-#define YACA_AGENTRY_EMPTY ~0U	/*0xffffffff */
-
-struct yaca_agentry_st
-{
-  unsigned age_magic;		/* always YACA_AGENTRY_MAGIC (or 0 or
-				   YACA_AGENTRY_EMPTY for an empty
-				   entry) */
-  uint16_t age_prio;		/* priority of the tasklet */
-  struct yaca_item_st *age_item;	/* task item */
-  /* next and previous indexes in the priority queue */
-  yaca_agindex_t age_nextix;
-#define age_nextfreeix age_nextix
-  yaca_agindex_t age_previx;
-  yaca_agindex_t age_hashix;	/* index in hashtable */
-};
-
+/** The global agenda has a doubly linked queue for each priority,
+   threaded through the itm_agnext and itm_agprev fields of the task
+   items themselves, so adding, moving and removing a task never
+   allocates nor searches.
+**/
 struct yaca_agenda_st
 {
-  yaca_agindex_t ag_count;
-  yaca_agindex_t ag_size;	/* some prime number above ag_count */
-  struct yaca_agentry_st *ag_arr;	/* of ag_size elements, entry#0 unused */
-  yaca_agindex_t *ag_hasht;	/* of ag_size elements */
-  // head & tail index of each priority queue
-  yaca_agindex_t ag_headix[1 + (int) tkprio__last];
-  yaca_agindex_t ag_tailix[1 + (int) tkprio__last];
-  yaca_agindex_t ag_freeix;	/* index of first free element */
+  unsigned long ag_count;	/* number of queued tasks */
+  // head & tail of each priority queue
+  struct yaca_item_st *ag_head[tkprio__last];
+  struct yaca_item_st *ag_tail[tkprio__last];
   enum yaca_agenda_state_en ag_state;
+  uint64_t ag_prioset;		/* bit prio set if that queue is not empty */
 };
 static struct yaca_agenda_st agenda;
 
+/** Tasks added by a worker go into its own deque of their priority,
+   without any lock, following Chase & Lev: the owner pushes and takes
+   at the bottom, so it runs its latest tasks first, while other
+   workers steal at the top when they have nothing better to do. The
+   global agenda above is only used for the tasks added by other
+   threads.
+
+   An item knows its agenda state, in its itm_agstate word: its
+   priority when it is queued, a flag when it is in the global agenda,
+   and a generation incremented at each queuing. A deque slot also
+   keeps the generation of its item, and is stale once the item was
+   removed or queued again, so removing or moving an item queued in a
+   deque is a compare and swap of its state, and whoever takes a slot
+   claims its item the same way. Only the holder of the agenda mutex
+   can change the state of an item in the global agenda. Stale slots,
+   and the rings replaced when a deque grew, are freed by the GC while
+   the workers are stopped.
+
+   A deque grows without copying: its new ring starts empty, and an
+   empty slot there means the task is still in the older rings, which
+   stay readable. Each push then copies a few of these tasks into the
+   new ring, so no push pays for all of them.
+
+   Each priority queue of the global agenda, and each deque, has a bit
+   in a 64 bits set, so a worker finds the highest priority having
+   tasks by counting leading zeros, without looking at the empty
+   queues.
+**/
+#define YACA_AGSTATE_PRIOMASK 0xff
+#define YACA_AGSTATE_GLOBAL 0x100
+#define YACA_AGSTATE_GENSHIFT 9
+#define YACA_TASKRING_MINSIZE 64
+// tasks copied into a new ring at each push
+#define YACA_TASKRING_MIGRATE 8
+// most tasks moved at once from the global agenda to a worker deque
+#define YACA_AGENDA_BATCH 16
+
+struct yaca_taskslot_st
+{
+  struct yaca_item_st *tsl_item;
+  uint32_t tsl_gen;
+};
+
+struct yaca_taskring_st
+{
+  unsigned long tring_size;	/* a power of two */
+  struct yaca_taskring_st *tring_old;	/* the replaced ring */
+  // the indexes from tring_migrlo to tring_migrhi may still be only
+  // in the older rings; only the owner uses them
+  long tring_migrlo, tring_migrhi;
+  struct yaca_taskslot_st tring_slots[];	/* tring_size slots */
+};
+
+struct yaca_taskdeque_st
+{
+  long tdq_top __attribute__ ((aligned (64)));	/* atomically
+						   incremented, by thieves
+						   too */
+  long tdq_bottom __attribute__ ((aligned (64)));	/* by the owner */
+  struct yaca_taskring_st *tdq_ring;	/* published atomically */
+};
+
+static struct yaca_taskdeque_st
+  yaca_taskdeques[YACA_MAX_WORKERS + 1][tkprio__last];
+
+// for each worker, bit prio is set if its deque of that priority may
+// be non-empty; only the owner sets or clears it, thieves just read it
+static struct
+{
+  uint64_t tds_prioset;
+} __attribute__ ((aligned (64))) yaca_taskdequesets[YACA_MAX_WORKERS + 1];
+
+/** An idle worker parks on its own futex word, after setting its bit
+   in agenda_parkedmask. Whoever adds tasks clears the bits of as many
+   parked workers as it added tasks, and wakes exactly these ones. The
+   tick timer of a parked worker is disarmed, so it sleeps until a
+   task, an interrupt or the agenda stop concerns it.
+**/
+static struct
+{
+  uint32_t park_word;		/* 1 while parked */
+} __attribute__ ((aligned (64))) yaca_workerparks[YACA_MAX_WORKERS + 1];
+
+static uint32_t agenda_parkedmask;	/* bit of each parked worker */
+
+// set in worker threads having a tick timer
+static __thread bool agenda_hastimer;
+
+static __thread unsigned agenda_stealseed;
+
+// the slot of some index in a ring, or in an older one if it was not
+// copied yet
+static inline struct yaca_taskslot_st *
+ring_slot (struct yaca_taskring_st *ring, long ix)
+{
+  for (;;)
+    {
+      struct yaca_taskslot_st *slot =
+	ring->tring_slots + (ix & (ring->tring_size - 1));
+      if (__atomic_load_n (&slot->tsl_item, __ATOMIC_ACQUIRE) != NULL
+	  || !ring->tring_old)
+	return slot;
+      ring = ring->tring_old;
+    }
+}
+
+static inline void
+slot_put (struct yaca_taskslot_st *slot, struct yaca_item_st *itm,
+	  uint32_t gen)
+{
+  __atomic_store_n (&slot->tsl_gen, gen, __ATOMIC_RELAXED);
+  __atomic_store_n (&slot->tsl_item, itm, __ATOMIC_RELEASE);
+}
+
+static struct yaca_taskring_st *
+ring_allocate (unsigned long size)
+{
+  struct yaca_taskring_st *ring =
+    calloc (1, sizeof (struct yaca_taskring_st)
+	    + size * sizeof (struct yaca_taskslot_st));
+  if (!ring)
+    YACA_FATAL ("failed to allocate task ring of %lu", size);
+  ring->tring_size = size;
+  return ring;
+}
+
+// replace the full ring of a deque by an empty one twice bigger, whose
+// missing tasks are in the replaced ring
+static struct yaca_taskring_st *
+deque_grow (struct yaca_taskdeque_st *dq, long top, long bottom)
+{
+  struct yaca_taskring_st *oldring = dq->tdq_ring;
+  struct yaca_taskring_st *ring =
+    ring_allocate (oldring ? 2 * oldring->tring_size
+		   : YACA_TASKRING_MINSIZE);
+  // thieves may still read the old ring, so it is kept till the GC
+  ring->tring_old = oldring;
+  if (oldring)
+    {
+      ring->tring_migrlo = top;
+      ring->tring_migrhi = bottom;
+    }
+  __atomic_store_n (&dq->tdq_ring, ring, __ATOMIC_RELEASE);
+  return ring;
+}
+
+// copy a few tasks from the older rings, by the owner
+static void
+ring_migrate (struct yaca_taskring_st *ring, long top, long bottom)
+{
+  long lo = ring->tring_migrlo;
+  long hi = ring->tring_migrhi;
+  // the taken tasks are not needed, and the slot of an index below
+  // bottom - size may hold a newer task
+  if (lo < top)
+    lo = top;
+  if (lo < bottom - (long) ring->tring_size)
+    lo = bottom - (long) ring->tring_size;
+  for (int cnt = 0; cnt < YACA_TASKRING_MIGRATE && lo < hi; cnt++, lo++)
+    {
+      struct yaca_taskslot_st *slot =
+	ring->tring_slots + (lo & (ring->tring_size - 1));
+      if (slot->tsl_item)
+	continue;
+      struct yaca_taskslot_st *oldslot = ring_slot (ring->tring_old, lo);
+      slot_put (slot, oldslot->tsl_item, oldslot->tsl_gen);
+    }
+  ring->tring_migrlo = lo;
+}
+
+// push a task at the bottom of a deque of the current worker
+static void
+deque_push (struct yaca_taskdeque_st *dq, struct yaca_item_st *itm,
+	    uint32_t gen)
+{
+  long bottom = __atomic_load_n (&dq->tdq_bottom, __ATOMIC_RELAXED);
+  long top = __atomic_load_n (&dq->tdq_top, __ATOMIC_ACQUIRE);
+  struct yaca_taskring_st *ring = dq->tdq_ring;
+  if (YACA_UNLIKELY (!ring || bottom - top >= (long) ring->tring_size))
+    ring = deque_grow (dq, top, bottom);
+  else if (YACA_UNLIKELY (ring->tring_migrlo < ring->tring_migrhi))
+    ring_migrate (ring, top, bottom);
+  slot_put (ring->tring_slots + (bottom & (ring->tring_size - 1)), itm,
+	    gen);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  __atomic_store_n (&dq->tdq_bottom, bottom + 1, __ATOMIC_RELAXED);
+}
+
+// take the bottom slot of a deque of the current worker, or NULL
+static struct yaca_item_st *
+deque_take (struct yaca_taskdeque_st *dq, uint32_t * pgen)
+{
+  struct yaca_taskring_st *ring = dq->tdq_ring;
+  struct yaca_item_st *itm = NULL;
+  if (!ring)
+    return NULL;
+  long bottom = __atomic_load_n (&dq->tdq_bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n (&dq->tdq_bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  long top = __atomic_load_n (&dq->tdq_top, __ATOMIC_RELAXED);
+  if (top <= bottom)
+    {
+      struct yaca_taskslot_st *slot = ring_slot (ring, bottom);
+      itm = slot->tsl_item;
+      *pgen = slot->tsl_gen;
+      if (top == bottom)
+	{
+	  // the last slot, which a thief may be stealing
+	  if (!__atomic_compare_exchange_n (&dq->tdq_top, &top, top + 1,
+					    false, __ATOMIC_SEQ_CST,
+					    __ATOMIC_RELAXED))
+	    itm = NULL;
+	  __atomic_store_n (&dq->tdq_bottom, bottom + 1, __ATOMIC_RELAXED);
+	}
+    }
+  else
+    __atomic_store_n (&dq->tdq_bottom, bottom + 1, __ATOMIC_RELAXED);
+  return itm;
+}
+
+// steal the top slot of a deque of another worker, or NULL if empty
+static struct yaca_item_st *
+deque_steal (struct yaca_taskdeque_st *dq, uint32_t * pgen)
+{
+  for (;;)
+    {
+      long top = __atomic_load_n (&dq->tdq_top, __ATOMIC_ACQUIRE);
+      __atomic_thread_fence (__ATOMIC_SEQ_CST);
+      long bottom = __atomic_load_n (&dq->tdq_bottom, __ATOMIC_ACQUIRE);
+      if (top >= bottom)
+	return NULL;
+      struct yaca_taskring_st *ring =
+	__atomic_load_n (&dq->tdq_ring, __ATOMIC_ACQUIRE);
+      struct yaca_taskslot_st *slot = ring_slot (ring, top);
+      struct yaca_item_st *itm =
+	__atomic_load_n (&slot->tsl_item, __ATOMIC_RELAXED);
+      uint32_t gen = __atomic_load_n (&slot->tsl_gen, __ATOMIC_RELAXED);
+      // the slot may be torn only if we lose the race
+      if (__atomic_compare_exchange_n (&dq->tdq_top, &top, top + 1, false,
+				       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+	{
+	  *pgen = gen;
+	  return itm;
+	}
+    }
+}
+
+// claim the item of a taken slot, unless the slot is stale
+static inline bool
+agenda_claim (struct yaca_item_st *itm, uint32_t gen, unsigned prio)
+{
+  uint32_t queued = (gen << YACA_AGSTATE_GENSHIFT) | prio;
+  return __atomic_compare_exchange_n (&itm->itm_agstate, &queued,
+				      gen << YACA_AGSTATE_GENSHIFT, false,
+				      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+static inline bool
+deque_slot_valid (struct yaca_taskslot_st *slot, unsigned prio)
+{
+  return __atomic_load_n (&slot->tsl_item->itm_agstate, __ATOMIC_ACQUIRE)
+    == ((slot->tsl_gen << YACA_AGSTATE_GENSHIFT) | prio);
+}
+
+// push in a deque of the current worker, and note it is not empty
+static inline void
+deque_push_worker (int num, unsigned prio, struct yaca_item_st *itm,
+		   uint32_t gen)
+{
+  uint64_t bit = (uint64_t) 1 << prio;
+  deque_push (&yaca_taskdeques[num][prio], itm, gen);
+  if (!(__atomic_load_n (&yaca_taskdequesets[num].tds_prioset,
+			 __ATOMIC_RELAXED) & bit))
+    __atomic_or_fetch (&yaca_taskdequesets[num].tds_prioset, bit,
+		       __ATOMIC_SEQ_CST);
+}
+
 static struct yaca_worker_st yaca_gcworker;
 static struct yaca_worker_st yaca_fcgiworker;
 
@@ -89,11 +349,14 @@ static struct yaca_worker_st yaca_fcgiworker;
 static void *yaca_worker_work (void *);
 
 
-// return false if agenda stopped
+// run one task, return false if there was none
 static bool yaca_do_one_task (void);
 
 static void yaca_work_alarm_sigaction (int sig, siginfo_t * sinf, void *data);
 
+static void agenda_wake (unsigned nbtasks);
+static void worker_tick (struct yaca_worker_st *wrk, bool on);
+
 void
 yaca_start_agenda (void)
 {
@@ -106,12 +369,13 @@ yaca_start_agenda (void)
     sigaction (YACA_WORKER_SIGNAL, &alact, NULL);
   }
   pthread_mutex_lock (&yaca_agenda_mutex);
+  agenda.ag_state = yacag_run;
   // start the workers
   assert (yaca_nb_workers >= 2 && yaca_nb_workers <= YACA_MAX_WORKERS);
   for (unsigned ix = 1; ix <= yaca_nb_workers; ix++)
     {
       struct yaca_worker_st *tsk = yaca_worktab + ix;
-      assert (tsk->worker_thread != 0);
+      assert (tsk->worker_thread == 0);
       tsk->worker_num = ix;
       tsk->worker_magic = YACA_WORKER_MAGIC;
       pthread_create (&tsk->worker_thread, NULL, yaca_worker_work, tsk);
@@ -140,12 +404,14 @@ yaca_interrupt_agenda (enum yaca_interrupt_reason_en ireas)
       assert (tsk->worker_magic == YACA_WORKER_MAGIC);
       tsk->worker_interrupted = 1;
       if (ireas > yaint__none && ireas < yaint__last)
-	tsk->worker_need |= (1 << (int) ireas);
+	__atomic_fetch_or (&tsk->worker_need, 1U << (int) ireas,
+			   __ATOMIC_SEQ_CST);
       pthread_kill (tsk->worker_thread, YACA_WORKER_SIGNAL);
     }
   goto end;
 end:
   pthread_mutex_unlock (&yaca_agenda_mutex);
+  agenda_wake (YACA_MAX_WORKERS);
 }
 
 void
@@ -181,492 +447,902 @@ yaca_worker_work (void *d)
   yaca_this_worker = tsk;
   {
     struct sigevent sev = { };
-    struct itimerspec its = { };
     memset (&sev, 0, sizeof (sev));
-    memset (&its, 0, sizeof (its));
     sev.sigev_notify = SIGEV_SIGNAL;
     sev.sigev_signo = YACA_WORKER_SIGNAL;
     if (timer_create (CLOCK_MONOTONIC, &sev, &tsk->worker_timer))
       YACA_FATAL ("failed to create time for worker #%d - %m",
 		  tsk->worker_num);
-    its.it_interval.tv_sec = YACA_WORKER_TICKMILLISEC / 1000;
-    its.it_interval.tv_nsec = (YACA_WORKER_TICKMILLISEC % 1000) * 1000000;
-    its.it_value = its.it_interval;
-    timer_settime (tsk->worker_timer, 0, &its, NULL);
+    agenda_hastimer = true;
+    worker_tick (tsk, true);
   }
   sched_yield ();
   for (;;)
     {
-      if (yaca_do_one_task ())
-	{
-	  break;
-	}
+      if (!yaca_do_one_task ()
+	  && __atomic_load_n (&agenda.ag_state, __ATOMIC_ACQUIRE) != yacag_run)
+	break;
       cnt++;
       if (YACA_UNLIKELY (cnt % 1024 == 0))
 	sched_yield ();
+      // the needs are atomically or-ed by yaca_interrupt_agenda
       uint32_t need = 0;
-      {
-	pthread_mutex_lock (&yaca_agenda_mutex);
-	need = tsk->worker_need;
-	tsk->worker_need = 0;
-	pthread_mutex_unlock (&yaca_agenda_mutex);
-      }
+      if (YACA_UNLIKELY (__atomic_load_n (&tsk->worker_need,
+					  __ATOMIC_RELAXED)))
+	need = __atomic_exchange_n (&tsk->worker_need, 0, __ATOMIC_ACQ_REL);
       if (need & (1 << yaint_gc))
 	yaca_worker_garbcoll ();
     }
 #warning incomplete yaca_worker_work
+  return NULL;
 }
 
+// unlink an item from its priority queue of the global agenda, with
+// the agenda mutex held
+static void
+agenda_unlink (struct yaca_item_st *agitm, unsigned prio)
+{
+  assert (prio > 0 && prio < (int) tkprio__last);
+  struct yaca_item_st *previtm = agitm->itm_agprev;
+  struct yaca_item_st *nextitm = agitm->itm_agnext;
+  if (!previtm)
+    agenda.ag_head[prio] = nextitm;
+  else
+    previtm->itm_agnext = nextitm;
+  if (!nextitm)
+    agenda.ag_tail[prio] = previtm;
+  else
+    nextitm->itm_agprev = previtm;
+  agitm->itm_agprev = agitm->itm_agnext = NULL;
+  if (!agenda.ag_head[prio])
+    __atomic_and_fetch (&agenda.ag_prioset, ~((uint64_t) 1 << prio),
+			__ATOMIC_RELAXED);
+}
 
+// put an item at the front or back of a priority queue of the global
+// agenda, with the agenda mutex held
 static void
-initialize_agenda (unsigned sizlow)
-{
-  unsigned long primsiz = yaca_prime_after (sizlow + 10);
-  if (YACA_UNLIKELY (primsiz < sizlow || primsiz > UINT_MAX))
-    YACA_FATAL ("cannot initialize agenda of %u elements", sizlow);
-  agenda.ag_count = 0;
-  agenda.ag_size = primsiz;
-  struct yaca_agentry_st *arr =
-    calloc (primsiz, sizeof (struct yaca_agentry_st));
-  if (YACA_UNLIKELY (!arr))
-    YACA_FATAL ("cannot allocate agenda entry table of %lu elements",
-		primsiz);
-  agenda.ag_arr = arr;
-  agenda.ag_hasht = calloc (primsiz, sizeof (yaca_agindex_t));
-  if (YACA_UNLIKELY (!agenda.ag_hasht))
-    YACA_FATAL ("cannot allocate agenda hash table of %lu elements", primsiz);
-  // make the free list, but skip entry#0
-  yaca_agindex_t frix = 0;
-  for (yaca_agindex_t ix = primsiz - 1; ix > 0; ix--)
+agenda_put (struct yaca_item_st *agitm, unsigned prio, bool front)
+{
+  uint32_t oldstate = __atomic_load_n (&agitm->itm_agstate, __ATOMIC_ACQUIRE);
+  uint32_t newstate = 0;
+  // an item already in the global agenda is moved
+  if (oldstate & YACA_AGSTATE_GLOBAL)
+    agenda_unlink (agitm, oldstate & YACA_AGSTATE_PRIOMASK);
+  else
+    __atomic_add_fetch (&agenda.ag_count, 1, __ATOMIC_RELAXED);
+  // an item queued in a deque may be taken meanwhile
+  do
+    newstate = ((((oldstate >> YACA_AGSTATE_GENSHIFT) + 1)
+		 << YACA_AGSTATE_GENSHIFT) | YACA_AGSTATE_GLOBAL | prio);
+  while (!__atomic_compare_exchange_n (&agitm->itm_agstate, &oldstate,
+				       newstate, false, __ATOMIC_ACQ_REL,
+				       __ATOMIC_ACQUIRE));
+  if (!agenda.ag_head[prio])
+    {
+      agenda.ag_head[prio] = agenda.ag_tail[prio] = agitm;
+      __atomic_or_fetch (&agenda.ag_prioset, (uint64_t) 1 << prio,
+			 __ATOMIC_SEQ_CST);
+    }
+  else if (front)
+    {
+      agitm->itm_agnext = agenda.ag_head[prio];
+      agenda.ag_head[prio]->itm_agprev = agitm;
+      agenda.ag_head[prio] = agitm;
+    }
+  else
     {
-      arr[ix].age_nextfreeix = frix;
-      frix = ix;
-    };
-  agenda.ag_freeix = frix;
+      agitm->itm_agprev = agenda.ag_tail[prio];
+      agenda.ag_tail[prio]->itm_agnext = agitm;
+      agenda.ag_tail[prio] = agitm;
+    }
 }
 
-
-static struct yaca_agentry_st *
-find_agentry (struct yaca_item_st *agitm)
+// move up to nbmax tasks from the head of a priority queue of the
+// global agenda to the bottom of the deque of the current worker, in
+// reverse order so that it runs them in their agenda order; return the
+// number moved
+static unsigned
+agenda_take_batch (int num, unsigned prio, unsigned nbmax)
 {
-  if (!agitm)
-    return NULL;
-  assert (agitm->itm_magic == YACA_ITEM_MAGIC);
-  yaca_agindex_t siz = agenda.ag_size;
-  assert (siz > 2);
-  yaca_agindex_t cnt = agenda.ag_count;
-  assert (cnt + 1 < siz);
-  struct yaca_agentry_st *arr = agenda.ag_arr;
-  yaca_agindex_t *hasht = agenda.ag_hasht;
-  assert (arr != NULL);
-  assert (hasht != NULL);
-  yaca_agindex_t ith = agitm->itm_id % siz;
-  for (yaca_agindex_t hx = ith; hx < siz; hx++)
+  struct yaca_item_st *batch[YACA_AGENDA_BATCH];
+  uint32_t gens[YACA_AGENDA_BATCH];
+  unsigned nb = 0;
+  if (nbmax > YACA_AGENDA_BATCH)
+    nbmax = YACA_AGENDA_BATCH;
+  pthread_mutex_lock (&yaca_agenda_mutex);
+  while (nb < nbmax && agenda.ag_head[prio])
     {
-      yaca_agindex_t curix = hasht[hx];
-      if (!curix)
-	return NULL;
-      if (curix == YACA_AGENTRY_EMPTY)
-	continue;
-      assert (curix < siz);
-      struct yaca_agentry_st *ae = arr + curix;
-      if (ae->age_magic == 0)
-	return NULL;
-      if (ae->age_magic == YACA_AGENTRY_EMPTY)
-	continue;
-      if (ae->age_magic == YACA_AGENTRY_MAGIC && ae->age_item == agitm)
-	return ae;
+      struct yaca_item_st *agitm = agenda.ag_head[prio];
+      agenda_unlink (agitm, prio);
+      // with the mutex held, nobody else changes the state of an item
+      // of the global agenda
+      uint32_t state =
+	__atomic_load_n (&agitm->itm_agstate, __ATOMIC_RELAXED);
+      assert ((state & YACA_AGSTATE_GLOBAL)
+	      && (state & YACA_AGSTATE_PRIOMASK) == prio);
+      gens[nb] = (state >> YACA_AGSTATE_GENSHIFT) + 1;
+      __atomic_store_n (&agitm->itm_agstate,
+			(gens[nb] << YACA_AGSTATE_GENSHIFT) | prio,
+			__ATOMIC_RELEASE);
+      batch[nb++] = agitm;
     }
-  for (yaca_agindex_t hx = 0; hx < ith; hx++)
+  __atomic_sub_fetch (&agenda.ag_count, nb, __ATOMIC_RELAXED);
+  // push while still holding the mutex, so yaca_agenda_gcmark sees
+  // the moved tasks
+  for (unsigned bix = nb; bix > 0; bix--)
+    deque_push_worker (num, prio, batch[bix - 1], gens[bix - 1]);
+  pthread_mutex_unlock (&yaca_agenda_mutex);
+  return nb;
+}
+
+// remove an item from the global agenda, with the agenda mutex held,
+// and give its old state
+static uint32_t
+agenda_remove_global (struct yaca_item_st *agitm)
+{
+  uint32_t state = __atomic_load_n (&agitm->itm_agstate, __ATOMIC_ACQUIRE);
+  if (!(state & YACA_AGSTATE_GLOBAL))
+    return state;
+  agenda_unlink (agitm, state & YACA_AGSTATE_PRIOMASK);
+  __atomic_sub_fetch (&agenda.ag_count, 1, __ATOMIC_RELAXED);
+  __atomic_store_n (&agitm->itm_agstate,
+		    state & ~(YACA_AGSTATE_GLOBAL | YACA_AGSTATE_PRIOMASK),
+		    __ATOMIC_RELEASE);
+  return state;
+}
+
+// is there some task for the workers? racy unless they are stopped
+static bool
+agenda_has_work (void)
+{
+  if (__atomic_load_n (&agenda.ag_count, __ATOMIC_SEQ_CST) > 0)
+    return true;
+  // a set bit may be stale after thieves emptied a deque
+  for (unsigned wix = 1; wix <= yaca_nb_workers; wix++)
+    for (uint64_t set =
+	 __atomic_load_n (&yaca_taskdequesets[wix].tds_prioset,
+			  __ATOMIC_SEQ_CST); set != 0; set &= set - 1)
+      {
+	struct yaca_taskdeque_st *dq =
+	  &yaca_taskdeques[wix][__builtin_ctzll (set)];
+	if (__atomic_load_n (&dq->tdq_top, __ATOMIC_SEQ_CST)
+	    < __atomic_load_n (&dq->tdq_bottom, __ATOMIC_SEQ_CST))
+	  return true;
+      }
+  return false;
+}
+
+static inline long
+agenda_futex (uint32_t * addr, int op, uint32_t val,
+	      const struct timespec *timeout)
+{
+  return syscall (SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+// wake a worker if it is parked, and tell if it was
+static bool
+agenda_unpark (int num)
+{
+  uint32_t bit = 1U << num;
+  if (!(__atomic_fetch_and (&agenda_parkedmask, ~bit, __ATOMIC_SEQ_CST)
+	& bit))
+    return false;
+  __atomic_store_n (&yaca_workerparks[num].park_word, 0, __ATOMIC_SEQ_CST);
+  agenda_futex (&yaca_workerparks[num].park_word, FUTEX_WAKE_PRIVATE, 1,
+		NULL);
+  return true;
+}
+
+// wake at most nbtasks parked workers, after adding tasks
+static void
+agenda_wake (unsigned nbtasks)
+{
+  // pairs with the setting of its bit by a parking worker, before it
+  // looks for work
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  uint32_t mask = __atomic_load_n (&agenda_parkedmask, __ATOMIC_SEQ_CST);
+  while (nbtasks > 0 && mask != 0)
     {
-      yaca_agindex_t curix = hasht[hx];
-      if (!curix)
-	return NULL;
-      if (curix == YACA_AGENTRY_EMPTY)
-	continue;
-      assert (curix < siz);
-      struct yaca_agentry_st *ae = arr + curix;
-      if (ae->age_magic == 0)
-	return NULL;
-      if (ae->age_magic == YACA_AGENTRY_EMPTY)
-	continue;
-      if (ae->age_magic == YACA_AGENTRY_MAGIC && ae->age_item == agitm)
-	return ae;
+      unsigned wix = __builtin_ctz (mask);
+      mask &= ~(1U << wix);
+      // unless woken by someone else
+      if (agenda_unpark (wix))
+	nbtasks--;
     }
-  return NULL;
 }
 
-
-// add or find an entry, but don't bother adding it to priority queues
-// (it is the role of the caller)
-static struct yaca_agentry_st *
-add_agentry (struct yaca_item_st *agitm, unsigned prio)
+// push an item in the deque of the current worker, without waking
+// anyone
+static void
+agenda_push_worker (struct yaca_item_st *agitm, unsigned prio)
 {
-  if (!agitm)
-    return NULL;
-  assert (agitm->itm_magic == YACA_ITEM_MAGIC);
-  yaca_agindex_t siz = agenda.ag_size;
-  assert (siz > 2);
-  yaca_agindex_t cnt = agenda.ag_count;
-  assert (cnt + 5 < siz);
-  struct yaca_agentry_st *arr = agenda.ag_arr;
-  yaca_agindex_t *hasht = agenda.ag_hasht;
-  assert (arr != NULL);
-  assert (hasht != NULL);
-  assert (agenda.ag_freeix > 0 && agenda.ag_freeix < siz);
-  int hpos = -1;
-  yaca_agindex_t ith = agitm->itm_id % siz;
-  for (yaca_agindex_t hx = ith; hx < siz; hx++)
+  uint32_t oldstate = __atomic_load_n (&agitm->itm_agstate, __ATOMIC_ACQUIRE);
+  uint32_t newstate = 0;
+  for (;;)
     {
-      yaca_agindex_t curix = hasht[hx];
-      if (!curix)
-	{
-	  if (hpos < 0)
-	    hpos = hx;
-	  break;
-	}
-      else if (curix == YACA_AGENTRY_EMPTY)
-	{
-	  if (hpos < 0)
-	    hpos = hx;
-	  continue;
-	}
-      assert (curix < siz);
-      struct yaca_agentry_st *ae = arr + curix;
-      if (ae->age_magic == 0)
-	{
-	  if (hpos < 0)
-	    hpos = hx;
-	  break;
-	}
-      if (ae->age_magic == YACA_AGENTRY_EMPTY)
+      if (oldstate & YACA_AGSTATE_GLOBAL)
 	{
-	  if (hpos < 0)
-	    hpos = hx;
+	  // only the holder of the agenda mutex moves an item out of the
+	  // global agenda
+	  pthread_mutex_lock (&yaca_agenda_mutex);
+	  oldstate = agenda_remove_global (agitm);
+	  uint32_t removedstate =
+	    oldstate & ~(YACA_AGSTATE_GLOBAL | YACA_AGSTATE_PRIOMASK);
+	  newstate = ((((oldstate >> YACA_AGSTATE_GENSHIFT) + 1)
+		       << YACA_AGSTATE_GENSHIFT) | prio);
+	  bool moved = (oldstate & YACA_AGSTATE_GLOBAL)
+	    && __atomic_compare_exchange_n (&agitm->itm_agstate,
+					    &removedstate, newstate, false,
+					    __ATOMIC_ACQ_REL,
+					    __ATOMIC_ACQUIRE);
+	  pthread_mutex_unlock (&yaca_agenda_mutex);
+	  if (moved)
+	    break;
+	  oldstate = __atomic_load_n (&agitm->itm_agstate, __ATOMIC_ACQUIRE);
 	  continue;
 	}
-      if (ae->age_magic == YACA_AGENTRY_MAGIC && ae->age_item == agitm)
-	return ae;
+      newstate = ((((oldstate >> YACA_AGSTATE_GENSHIFT) + 1)
+		   << YACA_AGSTATE_GENSHIFT) | prio);
+      if (__atomic_compare_exchange_n (&agitm->itm_agstate, &oldstate,
+				       newstate, false, __ATOMIC_ACQ_REL,
+				       __ATOMIC_ACQUIRE))
+	break;
     }
-  for (yaca_agindex_t hx = 0; hx < ith; hx++)
+  deque_push_worker (yaca_this_worker->worker_num, prio, agitm,
+		     newstate >> YACA_AGSTATE_GENSHIFT);
+}
+
+// can an item be added as a task of some priority?
+static bool
+agenda_task_ok (struct yaca_item_st *agitm, enum yaca_taskprio_en prio)
+{
+  if (!agitm)
+    return false;
+  assert (agitm->itm_magic == YACA_ITEM_MAGIC);
+  if ((int) prio <= 0 || (int) prio >= (int) tkprio__last)
+    return false;
+  struct yaca_itemtype_st *typit =
+    yaca_typetab[agitm->itm_typnum % YACA_ITEM_MAX_TYPE];
+  assert (typit && typit->typ_magic == YACA_TYPE_MAGIC);
+  return typit->typr_runitem != NULL;
+}
+
+// tasks added by a worker go into its own deque
+static inline bool
+agenda_in_worker (void)
+{
+  return yaca_this_worker && yaca_this_worker->worker_num > 0
+    && yaca_this_worker->worker_magic == YACA_WORKER_MAGIC;
+}
+
+// common to yaca_agenda_add_back and yaca_agenda_add_front
+static bool
+agenda_add (struct yaca_item_st *agitm, enum yaca_taskprio_en prio,
+	    bool front)
+{
+  if (!agenda_task_ok (agitm, prio))
+    return false;
+  if (agenda_in_worker ())
     {
-      yaca_agindex_t curix = hasht[hx];
-      if (!curix)
-	{
-	  if (hpos < 0)
-	    hpos = hx;
-	  break;
-	}
-      else if (curix == YACA_AGENTRY_EMPTY)
-	{
-	  if (hpos < 0)
-	    hpos = hx;
-	  continue;
-	}
-      assert (curix < siz);
-      struct yaca_agentry_st *ae = arr + curix;
-      if (ae->age_magic == 0)
-	{
-	  if (hpos < 0)
-	    hpos = hx;
-	  break;
-	}
-      if (ae->age_magic == YACA_AGENTRY_EMPTY)
-	{
-	  if (hpos < 0)
-	    hpos = hx;
-	  continue;
-	}
-      if (ae->age_magic == YACA_AGENTRY_MAGIC && ae->age_item == agitm)
-	return ae;
+      agenda_push_worker (agitm, prio);
+      agenda_wake (1);
+      return true;
     }
-  assert (hpos >= 0 && hpos < siz);
-  yaca_agindex_t nix = agenda.ag_freeix;
-  assert (nix > 0 && nix < siz);
-  struct yaca_agentry_st *nae = arr + nix;
-  agenda.ag_freeix = nae->age_nextfreeix;
-  agenda.ag_count++;
-  memset (nae, 0, sizeof (*nae));
-  nae->age_magic = YACA_AGENTRY_MAGIC;
-  nae->age_prio = prio;
-  nae->age_item = agitm;
-  nae->age_hashix = hpos;
-  hasht[hpos] = nix;
-  return nae;
+  pthread_mutex_lock (&yaca_agenda_mutex);
+  agenda_put (agitm, prio, front);
+  pthread_mutex_unlock (&yaca_agenda_mutex);
+  agenda_wake (1);
+  return true;
 }
 
+bool
+yaca_agenda_add_back (struct yaca_item_st *agitm, enum yaca_taskprio_en prio)
+{
+  return agenda_add (agitm, prio, false);
+}
 
-static void
-reorganize_agenda (unsigned gap)
-{
-  struct yaca_agenda_st oldagenda = agenda;
-  yaca_agindex_t oldcount = oldagenda.ag_count;
-  yaca_agindex_t oldsize = oldagenda.ag_size;
-  struct yaca_agentry_st *oldarr = oldagenda.ag_arr;
-  enum yaca_agenda_state_en oldstate = oldagenda.ag_state;
-  assert (oldarr != NULL);
-  initialize_agenda (3 * oldcount / 2 + 50 + gap);
-  for (unsigned prio = 1; prio < tkprio__last; prio++)
+bool
+yaca_agenda_add_front (struct yaca_item_st *agitm,
+		       enum yaca_taskprio_en prio)
+{
+  return agenda_add (agitm, prio, true);
+}
+
+unsigned
+yaca_agenda_add_batch (struct yaca_item_st **items, unsigned nb,
+		       enum yaca_taskprio_en prio)
+{
+  unsigned nbadded = 0;
+  if (!items || nb == 0)
+    return 0;
+  if (agenda_in_worker ())
     {
-      for (yaca_agindex_t ix = oldagenda.ag_headix[prio];
-	   ix > 0; ix = oldarr[ix].age_nextix)
-	{
-	  assert (ix > 0 && ix < oldsize);
-	  struct yaca_agentry_st *oldae = oldarr + ix;
-	  assert (oldae->age_magic == YACA_AGENTRY_MAGIC);
-	  assert (oldae->age_item != NULL);
-	  assert (oldae->age_prio == prio);
-	  yaca_agindex_t pfrix = agenda.ag_freeix;
-	  assert (pfrix > 0);
-	  struct yaca_agentry_st *ae = add_agentry (oldae->age_item, prio);
-	  assert (ae == agenda.ag_arr + pfrix);
-	  assert (ae->age_nextix == 0 && ae->age_previx == 0);
-	  if (agenda.ag_headix[prio] == 0)
-	    {
-	      agenda.ag_headix[prio] = agenda.ag_tailix[prio] = pfrix;
-	    }
-	  else
-	    {
-	      yaca_agindex_t tailix = agenda.ag_tailix[prio];
-	      assert (tailix > 0 && tailix < agenda.ag_size);
-	      struct yaca_agentry_st *tailae = agenda.ag_arr + tailix;
-	      assert (tailae->age_magic == YACA_AGENTRY_MAGIC);
-	      tailae->age_nextix = pfrix;
-	      ae->age_previx = tailix;
-	      agenda.ag_tailix[prio] = pfrix;
-	    }
-	}
-    };
-  memset (oldagenda.ag_arr, 0, sizeof (struct yaca_agentry_st) * oldsize);
-  memset (oldagenda.ag_hasht, 0, sizeof (yaca_agindex_t) * oldsize);
-  free (oldagenda.ag_arr);
-  free (oldagenda.ag_hasht);
-  agenda.ag_state = oldstate;
+      for (unsigned ix = 0; ix < nb; ix++)
+	if (agenda_task_ok (items[ix], prio))
+	  {
+	    agenda_push_worker (items[ix], prio);
+	    nbadded++;
+	  }
+      agenda_wake (nbadded);
+      return nbadded;
+    }
+  pthread_mutex_lock (&yaca_agenda_mutex);
+  for (unsigned ix = 0; ix < nb; ix++)
+    if (agenda_task_ok (items[ix], prio))
+      {
+	agenda_put (items[ix], prio, false);
+	nbadded++;
+      }
+  pthread_mutex_unlock (&yaca_agenda_mutex);
+  agenda_wake (nbadded);
+  return nbadded;
 }
 
-// unlink an existing agenda entry from its priority queue
+/** Delayed and periodic tasks wait in a hierarchical timer wheel,
+   following Varghese & Lauck: YACA_TIMER_LEVELS levels of 64 slots,
+   the slots of level L spanning 64^L ticks of a millisecond. A timer
+   goes in the slot of its due tick at the lowest level whose span
+   covers its delay, so inserting and cancelling are O(1). When the
+   wheel reaches the start of a slot of some higher level, its timers
+   are moved to lower levels, and those of the current slot of level 0
+   are due: their tasks are added to the global agenda, and periodic
+   ones are inserted again. The wheel is advanced by the workers
+   before looking for a task. When they are all parked, one of them,
+   the timekeeper, parks only until the next slot holding timers.
+
+   The timer of an item is reached from its itm_agtimer field. The
+   agenda mutex is always locked after the timer mutex, never before.
+**/
+#define YACA_TIMER_LEVELS 6
+#define YACA_TIMER_SLOTBITS 6
+#define YACA_TIMER_SLOTS (1 << YACA_TIMER_SLOTBITS)
+
+struct yaca_agtimer_st
+{
+  struct yaca_agtimer_st *tim_next;	/* in its slot, or in the free list */
+  struct yaca_agtimer_st *tim_prev;
+  struct yaca_item_st *tim_item;
+  uint64_t tim_due;		/* due tick */
+  uint32_t tim_period;		/* in ticks, or 0 for a single run */
+  uint8_t tim_prio;
+  uint8_t tim_level;
+  uint8_t tim_slot;
+};
+
+static pthread_mutex_t yaca_timer_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct
+{
+  uint64_t now;			/* last tick processed */
+  uint64_t nextdue;		/* no timer is due before that tick */
+  unsigned long count;		/* number of pending timers */
+  uint64_t occupied[YACA_TIMER_LEVELS];	/* bits of the non-empty slots */
+  struct yaca_agtimer_st *slots[YACA_TIMER_LEVELS][YACA_TIMER_SLOTS];
+  struct yaca_agtimer_st *freelist;
+} agenda_timers =
+{
+.nextdue = UINT64_MAX};
+
+// worker number of the timekeeper, or 0
+static int agenda_timekeeper;
+
+// the current tick, in milliseconds
+static inline uint64_t
+agenda_timer_ticks (void)
+{
+  struct timespec ts = { 0, 0 };
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// the tick ending some delay in seconds from now, rounded up so that a
+// timer never runs early
+static inline uint64_t
+agenda_timer_due (double delay)
+{
+  struct timespec ts = { 0, 0 };
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  double millis = ts.tv_sec * 1000.0 + ts.tv_nsec * 1.0e-6;
+  if (delay > 0.0)
+    millis += delay * 1000.0;
+  uint64_t due = (uint64_t) millis;
+  if ((double) due < millis)
+    due++;
+  return due;
+}
+
+// put a timer in its slot, with the timer mutex held; the ticks
+// after agenda_timers.now are not processed yet
 static void
-agenda_unlink (struct yaca_agentry_st *agel)
-{
-  assert (agel && agel->age_magic == YACA_AGENTRY_MAGIC);
-  unsigned oldprio = agel->age_prio;
-  // remove that entry from the oldprio
-  assert (oldprio > 0 && oldprio < (int) tkprio__last);
-  yaca_agindex_t oldprevix = agel->age_previx;
-  yaca_agindex_t oldnextix = agel->age_nextix;
-  assert (oldprevix < agenda.ag_size);
-  assert (oldnextix < agenda.ag_size);
-  if (oldprevix == 0)
-    agenda.ag_headix[oldprio] = oldnextix;
-  else
-    agenda.ag_arr[oldprevix].age_nextix = oldnextix;
-  if (oldnextix == 0)
-    agenda.ag_tailix[oldprio] = oldprevix;
+timer_insert (struct yaca_agtimer_st *tim)
+{
+  uint64_t base = agenda_timers.now + 1;
+  uint64_t due = tim->tim_due < base ? base : tim->tim_due;
+  unsigned level = 0;
+  while (level + 1 < YACA_TIMER_LEVELS
+	 && due - base >= (uint64_t) 1 << ((level + 1) * YACA_TIMER_SLOTBITS))
+    level++;
+  // beyond the wheel, it will be inserted again when its slot is reached
+  if (due - base >= (uint64_t) 1 << ((level + 1) * YACA_TIMER_SLOTBITS))
+    due = base + ((uint64_t) 1 << ((level + 1) * YACA_TIMER_SLOTBITS)) - 1;
+  unsigned slot =
+    (due >> (level * YACA_TIMER_SLOTBITS)) & (YACA_TIMER_SLOTS - 1);
+  struct yaca_agtimer_st *first = agenda_timers.slots[level][slot];
+  tim->tim_level = level;
+  tim->tim_slot = slot;
+  tim->tim_prev = NULL;
+  tim->tim_next = first;
+  if (first)
+    first->tim_prev = tim;
+  agenda_timers.slots[level][slot] = tim;
+  agenda_timers.occupied[level] |= (uint64_t) 1 << slot;
+}
+
+// take a timer out of its slot, with the timer mutex held
+static void
+timer_unlink (struct yaca_agtimer_st *tim)
+{
+  unsigned level = tim->tim_level, slot = tim->tim_slot;
+  if (tim->tim_prev)
+    tim->tim_prev->tim_next = tim->tim_next;
   else
-    agenda.ag_arr[oldnextix].age_previx = oldprevix;
+    agenda_timers.slots[level][slot] = tim->tim_next;
+  if (tim->tim_next)
+    tim->tim_next->tim_prev = tim->tim_prev;
+  if (!agenda_timers.slots[level][slot])
+    agenda_timers.occupied[level] &= ~((uint64_t) 1 << slot);
+  tim->tim_next = tim->tim_prev = NULL;
 }
 
-bool
-yaca_agenda_add_back (struct yaca_item_st *agitm, enum yaca_taskprio_en prio)
+// the first unprocessed tick when the wheel reaches a non-empty slot,
+// with the timer mutex held
+static uint64_t
+timer_next_due (void)
 {
-  if (!agitm)
+  uint64_t base = agenda_timers.now + 1;
+  uint64_t next = UINT64_MAX;
+  for (unsigned level = 0; level < YACA_TIMER_LEVELS; level++)
+    {
+      uint64_t occ = agenda_timers.occupied[level];
+      if (!occ)
+	continue;
+      unsigned shift = level * YACA_TIMER_SLOTBITS;
+      // the first slot boundary not processed, and the occupied slots
+      // from there
+      uint64_t bound = (base + ((uint64_t) 1 << shift) - 1) >> shift;
+      unsigned ix = bound & (YACA_TIMER_SLOTS - 1);
+      uint64_t rot =
+	ix ? (occ >> ix) | (occ << (YACA_TIMER_SLOTS - ix)) : occ;
+      uint64_t tick = (bound + __builtin_ctzll (rot)) << shift;
+      if (tick < next)
+	next = tick;
+    }
+  return next;
+}
+
+// cancel the timer of an item, with the timer mutex held, and give
+// its priority or 0
+static unsigned
+timer_cancel (struct yaca_item_st *itm)
+{
+  struct yaca_agtimer_st *tim = itm->itm_agtimer;
+  if (!tim)
+    return 0;
+  unsigned prio = tim->tim_prio;
+  timer_unlink (tim);
+  itm->itm_agtimer = NULL;
+  tim->tim_item = NULL;
+  tim->tim_next = agenda_timers.freelist;
+  agenda_timers.freelist = tim;
+  __atomic_sub_fetch (&agenda_timers.count, 1, __ATOMIC_SEQ_CST);
+  return prio;
+}
+
+static bool
+agenda_add_timer (struct yaca_item_st *agitm, enum yaca_taskprio_en prio,
+		  double delay, double period)
+{
+  if (!agenda_task_ok (agitm, prio) || period < 0.0)
     return false;
-  assert (agitm->itm_magic == YACA_ITEM_MAGIC);
-  if ((int) prio <= 0 || (int) prio >= (int) tkprio__last)
+  uint64_t periodticks = (uint64_t) (period * 1000.0);
+  if (period > 0.0 && periodticks == 0)
+    periodticks = 1;
+  if (periodticks > UINT32_MAX)
     return false;
-  {
-    struct yaca_itemtype_st *typit =
-      yaca_typetab[agitm->itm_typnum % YACA_ITEM_MAX_TYPE];
-    assert (typit && typit->typ_magic == YACA_TYPE_MAGIC);
-    if (!typit->typr_runitem)
-      return false;
-  }
-  pthread_mutex_lock (&yaca_agenda_mutex);
-  {
-    if (YACA_UNLIKELY (4 * agenda.ag_count + 50 >= 3 * agenda.ag_size))
-      reorganize_agenda (agenda.ag_count / 4 + 30);
-    yaca_agindex_t pfrix = agenda.ag_freeix;
-    assert (pfrix > 0);
-    struct yaca_agentry_st *agel = add_agentry (agitm, prio);
-    if (YACA_UNLIKELY (agel != agenda.ag_arr + pfrix))
-      {				// existing agenda entry; should unlink it
-	agenda_unlink (agel);
-      };
-    //add this entry at tail of priority queue
+  uint64_t due = agenda_timer_due (delay);
+  pthread_mutex_lock (&yaca_timer_mutex);
+  if (YACA_UNLIKELY (agenda_timers.now == 0))
+    agenda_timers.now = agenda_timer_ticks ();
+  struct yaca_agtimer_st *tim = agitm->itm_agtimer;
+  if (tim)
+    timer_unlink (tim);
+  else
     {
-      yaca_agindex_t oldtailix = agenda.ag_tailix[prio];
-      if (oldtailix == 0)
-	{
-	  agenda.ag_tailix[prio] = agenda.ag_headix[prio] = pfrix;
-	}
+      tim = agenda_timers.freelist;
+      if (tim)
+	agenda_timers.freelist = tim->tim_next;
+      else if (!(tim = calloc (1, sizeof (struct yaca_agtimer_st))))
+	YACA_FATAL ("failed to allocate timer");
+      tim->tim_item = agitm;
+      agitm->itm_agtimer = tim;
+      __atomic_add_fetch (&agenda_timers.count, 1, __ATOMIC_SEQ_CST);
+    }
+  tim->tim_prio = prio;
+  tim->tim_period = periodticks;
+  // the wheel may lag behind the clock
+  tim->tim_due = due;
+  if (tim->tim_due <= agenda_timers.now)
+    tim->tim_due = agenda_timers.now + 1;
+  timer_insert (tim);
+  bool earlier = tim->tim_due < agenda_timers.nextdue;
+  if (earlier)
+    __atomic_store_n (&agenda_timers.nextdue, tim->tim_due,
+		      __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock (&yaca_timer_mutex);
+  // the timekeeper should wait less, or some parked worker should
+  // become the timekeeper
+  if (earlier)
+    {
+      int tk = __atomic_load_n (&agenda_timekeeper, __ATOMIC_SEQ_CST);
+      if (tk > 0)
+	agenda_unpark (tk);
       else
-	{
-	  assert (oldtailix < agenda.ag_size);
-	  agel->age_previx = oldtailix;
-	  agenda.ag_arr[oldtailix].age_nextix = pfrix;
-	}
+	agenda_wake (1);
     }
-    pthread_cond_broadcast (&yaca_agendachanged_cond);
-  }
-  goto end;
-end:
-  pthread_mutex_unlock (&yaca_agenda_mutex);
   return true;
 }
 
-
+bool
+yaca_agenda_add_after (struct yaca_item_st *agitm,
+		       enum yaca_taskprio_en prio, double delay)
+{
+  return agenda_add_timer (agitm, prio, delay, 0.0);
+}
 
 bool
-yaca_agenda_add_front (struct yaca_item_st * agitm,
-		       enum yaca_taskprio_en prio)
+yaca_agenda_add_periodic (struct yaca_item_st *agitm,
+			  enum yaca_taskprio_en prio, double delay,
+			  double period)
 {
-  if (!agitm)
-    return false;
-  assert (agitm->itm_magic == YACA_ITEM_MAGIC);
-  if ((int) prio <= 0 || (int) prio >= (int) tkprio__last)
+  if (period <= 0.0)
     return false;
-  {
-    struct yaca_itemtype_st *typit =
-      yaca_typetab[agitm->itm_typnum % YACA_ITEM_MAX_TYPE];
-    assert (typit && typit->typ_magic == YACA_TYPE_MAGIC);
-    if (!typit->typr_runitem)
-      return false;
-  }
+  return agenda_add_timer (agitm, prio, delay, period);
+}
+
+#define YACA_TIMER_BATCH 64	/* due timers whose tasks are put at once */
+
+// put the tasks of some due timers in the global agenda, taking the
+// agenda mutex only meanwhile, then free the single-run timers, with
+// the timer mutex held; an item keeps its timer till its task is put,
+// so yaca_agenda_remove waits for us
+static void
+timer_put_due (struct yaca_agtimer_st **tims, unsigned nb)
+{
   pthread_mutex_lock (&yaca_agenda_mutex);
-  {
-    if (YACA_UNLIKELY (4 * agenda.ag_count + 50 >= 3 * agenda.ag_size))
-      reorganize_agenda (agenda.ag_count / 4 + 30);
-    yaca_agindex_t pfrix = agenda.ag_freeix;
-    assert (pfrix > 0);
-    struct yaca_agentry_st *agel = add_agentry (agitm, prio);
-    if (YACA_UNLIKELY (agel != agenda.ag_arr + pfrix))
-      {				// existing agenda entry; should unlink it
-	agenda_unlink (agel);
-      };
-    //add this entry at head of priority queue
+  for (unsigned ix = 0; ix < nb; ix++)
+    agenda_put (tims[ix]->tim_item, tims[ix]->tim_prio, false);
+  pthread_mutex_unlock (&yaca_agenda_mutex);
+  for (unsigned ix = 0; ix < nb; ix++)
+    {
+      struct yaca_agtimer_st *tim = tims[ix];
+      // periodic timers were inserted again
+      if (tim->tim_period > 0)
+	continue;
+      tim->tim_item->itm_agtimer = NULL;
+      tim->tim_item = NULL;
+      tim->tim_next = agenda_timers.freelist;
+      agenda_timers.freelist = tim;
+      __atomic_sub_fetch (&agenda_timers.count, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+// advance the timer wheel up to the current tick, adding the due tasks
+// to the global agenda; only one thread does it at a time. The wheel
+// jumps from one non-empty slot to the next, found thru the occupied
+// bitmaps.
+static void
+agenda_timers_advance (void)
+{
+  unsigned nbdue = 0, nbatch = 0;
+  struct yaca_agtimer_st *batch[YACA_TIMER_BATCH];
+  uint64_t ticks = agenda_timer_ticks ();
+  if (ticks < __atomic_load_n (&agenda_timers.nextdue, __ATOMIC_ACQUIRE))
+    return;
+  if (pthread_mutex_trylock (&yaca_timer_mutex))
+    return;
+  while (agenda_timers.now < ticks)
     {
-      yaca_agindex_t oldheadix = agenda.ag_headix[prio];
-      if (oldheadix == 0)
+      uint64_t t = timer_next_due ();
+      if (t > ticks)
 	{
-	  agenda.ag_headix[prio] = agenda.ag_tailix[prio] = pfrix;
+	  agenda_timers.now = ticks;
+	  break;
 	}
-      else
+      agenda_timers.now = t - 1;
+      // move down the timers of the higher slots starting at t
+      for (unsigned level = 1; level < YACA_TIMER_LEVELS; level++)
+	{
+	  unsigned shift = level * YACA_TIMER_SLOTBITS;
+	  if (t & (((uint64_t) 1 << shift) - 1))
+	    break;
+	  unsigned hslot = (t >> shift) & (YACA_TIMER_SLOTS - 1);
+	  struct yaca_agtimer_st *tim = agenda_timers.slots[level][hslot];
+	  agenda_timers.slots[level][hslot] = NULL;
+	  agenda_timers.occupied[level] &= ~((uint64_t) 1 << hslot);
+	  while (tim)
+	    {
+	      struct yaca_agtimer_st *nextim = tim->tim_next;
+	      timer_insert (tim);
+	      tim = nextim;
+	    }
+	}
+      // the due timers
+      unsigned slot = t & (YACA_TIMER_SLOTS - 1);
+      struct yaca_agtimer_st *tim = agenda_timers.slots[0][slot];
+      agenda_timers.slots[0][slot] = NULL;
+      agenda_timers.occupied[0] &= ~((uint64_t) 1 << slot);
+      while (tim)
 	{
-	  assert (oldheadix < agenda.ag_size);
-	  agel->age_nextix = oldheadix;
-	  agenda.ag_arr[oldheadix].age_previx = pfrix;
+	  struct yaca_agtimer_st *nextim = tim->tim_next;
+	  assert (tim->tim_due <= t);
+	  tim->tim_next = tim->tim_prev = NULL;
+	  batch[nbatch++] = tim;
+	  nbdue++;
+	  if (tim->tim_period > 0)
+	    {
+	      // skip the missed periods
+	      tim->tim_due += tim->tim_period;
+	      if (tim->tim_due <= t)
+		tim->tim_due = t + 1;
+	      timer_insert (tim);
+	    }
+	  if (nbatch >= YACA_TIMER_BATCH)
+	    {
+	      timer_put_due (batch, nbatch);
+	      nbatch = 0;
+	    }
+	  tim = nextim;
 	}
+      agenda_timers.now = t;
     }
-    pthread_cond_broadcast (&yaca_agendachanged_cond);
-  }
-  goto end;
-end:
-  pthread_mutex_unlock (&yaca_agenda_mutex);
-  return true;
+  if (nbatch > 0)
+    timer_put_due (batch, nbatch);
+  __atomic_store_n (&agenda_timers.nextdue, timer_next_due (),
+		    __ATOMIC_RELEASE);
+  pthread_mutex_unlock (&yaca_timer_mutex);
+  if (nbdue > 0)
+    agenda_wake (nbdue);
 }
 
 enum yaca_taskprio_en
 yaca_agenda_remove (struct yaca_item_st *agitm)
 {
-  enum yaca_taskprio_en oldprio = tkprio__none;
+  unsigned timprio = 0;
   if (!agitm)
     return tkprio__none;
   assert (agitm->itm_magic == YACA_ITEM_MAGIC);
-  pthread_mutex_lock (&yaca_agenda_mutex);
-  {
-    if (YACA_UNLIKELY
-	(3 * agenda.ag_count < agenda.ag_size && agenda.ag_size > 200))
-      reorganize_agenda (agenda.ag_count / 4 + 10);
-    struct yaca_agentry_st *agel = find_agentry (agitm);
-    if (!agel)
-      goto end;
-    assert (agel->age_magic == YACA_AGENTRY_MAGIC);
-    oldprio = agel->age_prio;
-    agenda_unlink (agel);
-    agenda.ag_count--;
-    pthread_cond_broadcast (&yaca_agendachanged_cond);
-  }
-  goto end;
-end:
-  pthread_mutex_unlock (&yaca_agenda_mutex);
-  return oldprio;
+  if (__atomic_load_n (&agitm->itm_agtimer, __ATOMIC_ACQUIRE))
+    {
+      pthread_mutex_lock (&yaca_timer_mutex);
+      timprio = timer_cancel (agitm);
+      pthread_mutex_unlock (&yaca_timer_mutex);
+    }
+  uint32_t state = __atomic_load_n (&agitm->itm_agstate, __ATOMIC_ACQUIRE);
+  for (;;)
+    {
+      if (state & YACA_AGSTATE_GLOBAL)
+	{
+	  pthread_mutex_lock (&yaca_agenda_mutex);
+	  state = agenda_remove_global (agitm);
+	  pthread_mutex_unlock (&yaca_agenda_mutex);
+	  if (state & YACA_AGSTATE_GLOBAL)
+	    break;
+	  continue;
+	}
+      if (!(state & YACA_AGSTATE_PRIOMASK))
+	break;
+      // queued in a deque, whose slot becomes stale
+      if (__atomic_compare_exchange_n (&agitm->itm_agstate, &state,
+				       state & ~YACA_AGSTATE_PRIOMASK, false,
+				       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	break;
+    }
+  if (!(state & YACA_AGSTATE_PRIOMASK))
+    return (enum yaca_taskprio_en) timprio;
+  return (enum yaca_taskprio_en) (state & YACA_AGSTATE_PRIOMASK);
+}
+
+enum yaca_taskprio_en
+yaca_deadline_prio (double delay)
+{
+  // one level less for each doubling of the delay in milliseconds
+  if (delay < 0.001)
+    return (enum yaca_taskprio_en) (tkprio__last - 1);
+  if (delay >= 2.0e6)
+    return tkprio_normal;
+  unsigned long millis = (unsigned long) (delay * 1000.0);
+  unsigned lg = 63 - __builtin_clzl (millis | 1);
+  if (lg >= tkprio__last - 1 - tkprio_normal)
+    return tkprio_normal;
+  return (enum yaca_taskprio_en) (tkprio__last - 1 - lg);
+}
+
+enum yaca_taskprio_en
+yaca_agenda_task_prio (struct yaca_item_st *agitm)
+{
+  if (!agitm)
+    return tkprio__none;
+  assert (agitm->itm_magic == YACA_ITEM_MAGIC);
+  return (enum yaca_taskprio_en)
+    (__atomic_load_n (&agitm->itm_agstate, __ATOMIC_ACQUIRE)
+     & YACA_AGSTATE_PRIOMASK);
+}
+
+// take a task of some priority: from our deque, else from the global
+// agenda, else from the deque of another worker
+static struct yaca_item_st *
+agenda_take_prio (int num, unsigned prio)
+{
+  struct yaca_item_st *agitm = NULL;
+  uint32_t gen = 0;
+  uint64_t bit = (uint64_t) 1 << prio;
+  if (__atomic_load_n (&yaca_taskdequesets[num].tds_prioset,
+		       __ATOMIC_RELAXED) & bit)
+    {
+      while ((agitm =
+	      deque_take (&yaca_taskdeques[num][prio], &gen)) != NULL)
+	if (agenda_claim (agitm, gen, prio))
+	  return agitm;
+      __atomic_and_fetch (&yaca_taskdequesets[num].tds_prioset, ~bit,
+			  __ATOMIC_RELAXED);
+    }
+  unsigned nbw = yaca_nb_workers;
+  // take our share of the global agenda in one go, so other workers
+  // can steal from it
+  if ((__atomic_load_n (&agenda.ag_prioset, __ATOMIC_RELAXED) & bit)
+      && agenda_take_batch (num, prio,
+			    __atomic_load_n (&agenda.ag_count,
+					     __ATOMIC_RELAXED) / nbw + 1) > 0)
+    while ((agitm = deque_take (&yaca_taskdeques[num][prio], &gen)) != NULL)
+      if (agenda_claim (agitm, gen, prio))
+	return agitm;
+  agenda_stealseed = agenda_stealseed * 1103515245 + 12345 + num;
+  unsigned start = (agenda_stealseed >> 16) % nbw;
+  for (unsigned k = 0; k < nbw; k++)
+    {
+      int victim = 1 + (start + k) % nbw;
+      if (victim == num
+	  || !(__atomic_load_n (&yaca_taskdequesets[victim].tds_prioset,
+				__ATOMIC_RELAXED) & bit))
+	continue;
+      while ((agitm = deque_steal (&yaca_taskdeques[victim][prio], &gen)))
+	if (agenda_claim (agitm, gen, prio))
+	  return agitm;
+    }
+  return NULL;
+}
+
+// arm or disarm the tick timer of the current worker
+static void
+worker_tick (struct yaca_worker_st *wrk, bool on)
+{
+  struct itimerspec its;
+  memset (&its, 0, sizeof (its));
+  if (on)
+    {
+      its.it_interval.tv_sec = YACA_WORKER_TICKMILLISEC / 1000;
+      its.it_interval.tv_nsec =
+	(YACA_WORKER_TICKMILLISEC % 1000) * 1000000;
+      its.it_value = its.it_interval;
+    }
+  if (agenda_hastimer)
+    timer_settime (wrk->worker_timer, 0, &its, NULL);
+}
+
+// park the current worker until it is woken
+static void
+agenda_park (struct yaca_worker_st *wrk)
+{
+  int num = wrk->worker_num;
+  uint32_t bit = 1U << num;
+  uint32_t *parkw = &yaca_workerparks[num].park_word;
+  wrk->worker_state = yawrk_idle;
+  __atomic_store_n (parkw, 1, __ATOMIC_SEQ_CST);
+  __atomic_or_fetch (&agenda_parkedmask, bit, __ATOMIC_SEQ_CST);
+  // check again, since a task added before our bit was set did not
+  // wake us
+  if (__atomic_load_n (&agenda.ag_state, __ATOMIC_SEQ_CST) == yacag_run
+      && !__atomic_load_n (&wrk->worker_need, __ATOMIC_SEQ_CST)
+      && !agenda_has_work ())
+    {
+      int nokeeper = 0;
+      bool keeper =
+	__atomic_load_n (&agenda_timers.count, __ATOMIC_SEQ_CST) > 0
+	&& __atomic_compare_exchange_n (&agenda_timekeeper, &nokeeper, num,
+					false, __ATOMIC_SEQ_CST,
+					__ATOMIC_SEQ_CST);
+      worker_tick (wrk, false);
+      // other signals interrupt the wait, but do not unpark us
+      while (__atomic_load_n (parkw, __ATOMIC_SEQ_CST))
+	{
+	  if (!keeper)
+	    {
+	      agenda_futex (parkw, FUTEX_WAIT_PRIVATE, 1, NULL);
+	      continue;
+	    }
+	  // the timekeeper waits till the next timer is due
+	  uint64_t due =
+	    __atomic_load_n (&agenda_timers.nextdue, __ATOMIC_SEQ_CST);
+	  uint64_t ticks = agenda_timer_ticks ();
+	  if (due <= ticks)
+	    break;
+	  uint64_t millis = due - ticks;
+	  if (millis > 3600 * 1000)
+	    millis = 3600 * 1000;
+	  struct timespec ts = { millis / 1000, (millis % 1000) * 1000000 };
+	  if (agenda_futex (parkw, FUTEX_WAIT_PRIVATE, 1, &ts) < 0
+	      && errno == ETIMEDOUT)
+	    break;
+	}
+      if (keeper)
+	__atomic_store_n (&agenda_timekeeper, 0, __ATOMIC_SEQ_CST);
+      worker_tick (wrk, true);
+    }
+  __atomic_and_fetch (&agenda_parkedmask, ~bit, __ATOMIC_SEQ_CST);
+  __atomic_store_n (parkw, 0, __ATOMIC_RELAXED);
 }
 
 bool
 yaca_do_one_task (void)
 {
-  static long docount;
   bool res = false;
   struct yaca_item_st *agitm = NULL;
-  pthread_mutex_lock (&yaca_agenda_mutex);
+  struct yaca_worker_st *wrk = yaca_this_worker;
+  assert (wrk && wrk->worker_magic == YACA_WORKER_MAGIC
+	  && wrk->worker_num > 0);
+  if (__atomic_load_n (&agenda.ag_state, __ATOMIC_ACQUIRE) != yacag_run)
+    return false;
+  if (__atomic_load_n (&agenda_timers.count, __ATOMIC_RELAXED) > 0)
+    agenda_timers_advance ();
+  // pin before taking, so the task item cannot be reclaimed if another
+  // thread destroys it
+  yaca_items_pin ();
   {
-    while (agenda.ag_count == 0 && agenda.ag_state == yacag_run)
-      {
-	struct timespec ts = { 0, 0 };
-	clock_gettime (CLOCK_REALTIME, &ts);
-	ts.tv_nsec += 2 * YACA_WORKER_TICKMILLISEC * 1000000;
-	while (YACA_UNLIKELY (ts.tv_nsec > 1000000000))
-	  {
-	    ts.tv_sec++;
-	    ts.tv_nsec -= 1000000000;
-	  };
-	pthread_cond_timedwait (&yaca_agendachanged_cond, &yaca_agenda_mutex,
-				&ts);
-      }
-    if (agenda.ag_state != yacag_run)
-      goto end;
-    if (agenda.ag_count == 0)
-      goto end;
-    for (unsigned prio = tkprio__last - 1; prio > 0 && !agitm; prio--)
-      {
-	yaca_agindex_t tix = 0;
-	yaca_agindex_t nextix = 0;
-	for (tix = agenda.ag_headix[prio]; tix != 0 && !agitm; tix = nextix)
-	  {
-	    if (!tix)
-	      break;
-	    nextix = 0;
-	    assert (tix > 0 && tix < agenda.ag_size);
-	    struct yaca_agentry_st *agel = agenda.ag_arr + tix;
-	    assert (agel->age_magic == YACA_AGENTRY_MAGIC);
-	    assert (agel->age_prio == prio);
-	    nextix = agel->age_nextix;
-	    agitm = agel->age_item;
-	    agenda_unlink (agel);
-	    agenda.ag_count--;
-	  }
-      }
-    if (agitm)
+    // the candidate priorities, tried from the highest
+    uint64_t prioset = __atomic_load_n (&agenda.ag_prioset, __ATOMIC_ACQUIRE);
+    for (unsigned wix = 1; wix <= yaca_nb_workers; wix++)
+      prioset |= __atomic_load_n (&yaca_taskdequesets[wix].tds_prioset,
+				  __ATOMIC_ACQUIRE);
+    while (prioset != 0 && !agitm)
       {
-	docount++;
-	if (YACA_UNLIKELY (docount % 1024 == 0
-			   && agenda.ag_size > 100
-			   && 3 * agenda.ag_count + 50 < agenda.ag_size))
-	  reorganize_agenda (agenda.ag_count / 4 + 10);
+	unsigned prio = 63 - __builtin_clzll (prioset);
+	prioset &= ~((uint64_t) 1 << prio);
+	agitm = agenda_take_prio (wrk->worker_num, prio);
       }
   }
-  goto end;
-end:
-  if (agitm)
-    yaca_this_worker->worker_state = yawrk_run;
-  else
-    yaca_this_worker->worker_state = yawrk_idle;
-  pthread_mutex_unlock (&yaca_agenda_mutex);
-  if (agitm)
+  if (!agitm)
     {
-      /// run the item
-      assert (agitm->itm_magic == YACA_ITEM_MAGIC);
-      yaca_typenum_t typnum = agitm->itm_typnum;
-      assert (typnum > 0 && typnum < YACA_ITEM_MAX_TYPE);
-      struct yaca_itemtype_st *typ = yaca_typetab[typnum];
-      assert (typ && typ->typ_magic == YACA_TYPE_MAGIC);
-      yaca_runitem_sig_t *run = typ->typr_runitem;
-      if (run)
-	{
-	  (*run) (agitm);
-	  res = true;
-	}
+      yaca_items_unpin ();
+      agenda_park (wrk);
+      return false;
     }
+  wrk->worker_state = yawrk_run;
+  {
+    /// run the item
+    assert (agitm->itm_magic == YACA_ITEM_MAGIC);
+    yaca_typenum_t typnum = agitm->itm_typnum;
+    assert (typnum > 0 && typnum < YACA_ITEM_MAX_TYPE);
+    struct yaca_itemtype_st *typ = yaca_typetab[typnum];
+    assert (typ && typ->typ_magic == YACA_TYPE_MAGIC);
+    yaca_runitem_sig_t *run = typ->typr_runitem;
+    if (run)
+      {
+	(*run) (agitm);
+	res = true;
+      }
+  }
+  yaca_items_unpin ();
   return res;
 }
 
@@ -680,6 +1356,7 @@ yaca_agenda_stop (void)
   goto end;
 end:
   pthread_mutex_unlock (&yaca_agenda_mutex);
+  agenda_wake (YACA_MAX_WORKERS);
 #warning should wait for all workers to stop
 }
 
@@ -696,6 +1373,7 @@ yaca_wait_workers_all_at_state (unsigned state)
   bool allatstate = true;
   do
     {
+      allatstate = true;
       for (unsigned ix = 1; ix <= yaca_nb_workers; ix++)
 	{
 	  struct yaca_worker_st *tsk = yaca_worktab + ix;
@@ -723,8 +1401,92 @@ end:
   pthread_mutex_unlock (&yaca_agenda_mutex);
 }
 
+void
+yaca_agenda_gcmark (void)
+{
+  // the timer mutex is never locked after the agenda one
+  pthread_mutex_lock (&yaca_timer_mutex);
+  for (unsigned level = 0; level < YACA_TIMER_LEVELS; level++)
+    for (unsigned slot = 0; slot < YACA_TIMER_SLOTS; slot++)
+      for (struct yaca_agtimer_st * tim = agenda_timers.slots[level][slot];
+	   tim; tim = tim->tim_next)
+	yaca_gc_mark_item (tim->tim_item);
+  pthread_mutex_unlock (&yaca_timer_mutex);
+  pthread_mutex_lock (&yaca_agenda_mutex);
+  for (unsigned prio = 1; prio < tkprio__last; prio++)
+    for (struct yaca_item_st * agitm = agenda.ag_head[prio];
+	 agitm; agitm = agitm->itm_agnext)
+      yaca_gc_mark_item (agitm);
+  // the deques may change meanwhile when marking concurrently, but
+  // their tasks added since are marked at the remark
+  for (unsigned wix = 1; wix <= yaca_nb_workers; wix++)
+    for (unsigned prio = 1; prio < tkprio__last; prio++)
+      {
+	struct yaca_taskdeque_st *dq = &yaca_taskdeques[wix][prio];
+	struct yaca_taskring_st *ring =
+	  __atomic_load_n (&dq->tdq_ring, __ATOMIC_ACQUIRE);
+	long top = __atomic_load_n (&dq->tdq_top, __ATOMIC_ACQUIRE);
+	long bottom = __atomic_load_n (&dq->tdq_bottom, __ATOMIC_ACQUIRE);
+	for (long ix = top; ring && ix < bottom; ix++)
+	  {
+	    struct yaca_taskslot_st *slot = ring_slot (ring, ix);
+	    if (slot->tsl_item && deque_slot_valid (slot, prio))
+	      yaca_gc_mark_item (slot->tsl_item);
+	  }
+      }
+  pthread_mutex_unlock (&yaca_agenda_mutex);
+}
+
+void
+yaca_agenda_gc_purge (void)
+{
+  for (unsigned wix = 1; wix <= yaca_nb_workers; wix++)
+    for (unsigned prio = 1; prio < tkprio__last; prio++)
+      {
+	struct yaca_taskdeque_st *dq = &yaca_taskdeques[wix][prio];
+	struct yaca_taskring_st *ring = dq->tdq_ring;
+	if (!ring)
+	  continue;
+	if (dq->tdq_top == dq->tdq_bottom && !ring->tring_old
+	    && ring->tring_size == YACA_TASKRING_MINSIZE)
+	  {
+	    dq->tdq_top = dq->tdq_bottom = 0;
+	    continue;
+	  }
+	// copy the valid slots, in order, into a fresh ring, which
+	// may be smaller
+	long nb = 0;
+	unsigned long newsiz = ring->tring_size;
+	for (long ix = dq->tdq_top; ix < dq->tdq_bottom; ix++)
+	  if (deque_slot_valid (ring_slot (ring, ix), prio))
+	    nb++;
+	while (newsiz > YACA_TASKRING_MINSIZE && 4 * nb < (long) newsiz)
+	  newsiz /= 2;
+	struct yaca_taskring_st *newring = ring_allocate (newsiz);
+	nb = 0;
+	for (long ix = dq->tdq_top; ix < dq->tdq_bottom; ix++)
+	  {
+	    struct yaca_taskslot_st *slot = ring_slot (ring, ix);
+	    if (deque_slot_valid (slot, prio))
+	      newring->tring_slots[nb++] = *slot;
+	  }
+	while (ring)
+	  {
+	    struct yaca_taskring_st *oldring = ring->tring_old;
+	    free (ring);
+	    ring = oldring;
+	  }
+	dq->tdq_ring = newring;
+	dq->tdq_top = 0;
+	dq->tdq_bottom = nb;
+      }
+}
+
 void
 yaca_should_garbage_collect (void)
 {
-  yaca_interrupt_agenda (yaint_gc);
+  if (yaca_gc_mode == yagc_concurrent)
+    yaca_gc_start_concurrent_mark ();
+  else
+    yaca_interrupt_agenda (yaint_gc);
 }
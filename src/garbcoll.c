@@ -25,10 +25,12 @@
 /** The garbage collector deals with memory regions. It is invoked only
    when the agenda is not running (and when every worker thread is in
    GC state). Memory regions have a fixed size (power of two, megabyte[s]).
-   Data in memory region may be copied.
+   Data in memory region may be copied, by a parallel copying
+   collector running in all the worker threads, after the live items
+   have been marked.
 **/
 
-// mutex for regions 
+// mutex for regions, taken only by writers (creating or deleting regions)
 static pthread_mutex_t yaca_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 
@@ -36,196 +38,261 @@ static pthread_mutex_t yaca_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t yaca_workalloc_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 
-// non-worker common small region
-static struct yaca_region_st *yaca_common_smallreg;
+/** Threads other than the numbered workers, e.g. the GC and FastCGI
+   special workers, allocate in their own thread-local allocation
+   buffer, without any lock. These threads are not stopped by the
+   collector, so it does not know which chunks they still hold: their
+   regions, and the large regions they made, are pinned. When such a
+   thread keeps no pointer to region data except in items, it calls
+   yaca_work_safepoint, which hands its full regions to the collector
+   and unpins its large regions; its current regions stay pinned. A
+   thread exiting hands all of them.
+**/
+struct yaca_tlab_st
+{
+  struct yaca_region_st *tlab_smallreg;
+  struct yaca_region_st *tlab_bigreg;
+  struct yaca_tlab_st *tlab_next;	/* in yaca_tlab_list */
+  unsigned long tlab_nballoc;
+  unsigned tlab_nblarge;	/* pinned large regions */
+  unsigned tlab_sizlarge;
+  struct yaca_region_st **tlab_large;	/* of tlab_sizlarge entries */
+};
 
-// comon big region
-static struct yaca_region_st *yaca_common_bigreg;
+// every thread-local allocation buffer, under yaca_workalloc_mutex
+static struct yaca_tlab_st *yaca_tlab_list;
+static unsigned nb_tlabs;
+static __thread struct yaca_tlab_st *yaca_this_tlab;
+static pthread_key_t yaca_tlab_key;
 
+// the regions handed by the buffers at their safepoints, to be
+// evacuated by the next collection, under yaca_workalloc_mutex
+static struct yaca_region_st *yaca_released_regions;
 
-// hashtable for small & big regions
-static struct
-{
-  unsigned count;
-  unsigned size;		/* a prime number */
-  struct yaca_region_st **arr;
-} smallregion, bigregion;
+// the allocations of large regions, which take a mutex
+static unsigned long nb_largealloc;
+// the allocations which took a mutex, for a large or a new region
+static unsigned long nb_lockedalloc;
+// the allocations made in the buffers of exited threads
+static unsigned long nb_exitedalloc;
+
+
+/** The page map associates to every small region sized slot of the
+   address space (that is, address >> SMALLREGION_LOG) the region
+   containing it, or NULL. It has two levels; leaves are allocated on
+   demand and never freed, so readers only need atomic loads and never
+   take the yaca_memory_mutex. A big region fills several
+   consecutive slots.
+**/
+#define YACA_PAGEMAP_ADDRBITS 48
+#define YACA_PAGEMAP_LEAFBITS 14
+#define YACA_PAGEMAP_TOPBITS \
+  (YACA_PAGEMAP_ADDRBITS - SMALLREGION_LOG - YACA_PAGEMAP_LEAFBITS)
+#define YACA_PAGEMAP_LEAFLEN (1UL << YACA_PAGEMAP_LEAFBITS)
+#define YACA_PAGEMAP_TOPLEN (1UL << YACA_PAGEMAP_TOPBITS)
+
+static struct yaca_region_st **yaca_pagemap[YACA_PAGEMAP_TOPLEN];
 
+// number of small & big regions
+static unsigned nb_smallregions, nb_bigregions;
 
 static long allocated_megabytes;
 
+// the large regions, chained thru reg_next, and their total size
+static struct yaca_region_st *yaca_large_regions;
+static unsigned nb_largeregions;
+static size_t large_allocated_bytes;
+
+// set the page map slots of a region, with the yaca_memory_mutex held
 static void
-add_smallregion (struct yaca_region_st *reg)
-{
-  unsigned count = smallregion.count;
-  unsigned size = smallregion.size;
-  struct yaca_region_st **arr = smallregion.arr;
-  assert (count + 5 < size && arr != NULL);
-  assert (reg != NULL && reg->reg_magic == YACA_SMALLREGION_MAGIC);
-  assert (((uintptr_t) reg % YACA_SMALLREGION_SIZE) == 0);
-  int pos = -1;
-  uintptr_t h = ((uintptr_t) reg / YACA_SMALLREGION_SIZE) % size;
-  for (unsigned ix = h; ix < size; ix++)
-    {
-      struct yaca_region_st *cureg = arr[ix];
-      if (cureg == reg)
-	return;
-      else if (cureg == NULL)
-	{
-	  if (pos < 0)
-	    pos = ix;
-	  arr[pos] = reg;
-	  smallregion.count = count + 1;
-	  reg->reg_index = pos;
-	  return;
-	}
-      else if (cureg == YACA_REGION_EMPTY)
+pagemap_set (void *ad, size_t size, struct yaca_region_st *reg)
+{
+  uintptr_t firstslot = (uintptr_t) ad >> SMALLREGION_LOG;
+  uintptr_t endslot = ((uintptr_t) ad + size) >> SMALLREGION_LOG;
+  if (YACA_UNLIKELY
+      (endslot > (YACA_PAGEMAP_TOPLEN << YACA_PAGEMAP_LEAFBITS)))
+    YACA_FATAL ("region@%p outside of page map", ad);
+  for (uintptr_t slot = firstslot; slot < endslot; slot++)
+    {
+      uintptr_t topix = slot >> YACA_PAGEMAP_LEAFBITS;
+      struct yaca_region_st **leaf = yaca_pagemap[topix];
+      if (YACA_UNLIKELY (!leaf))
 	{
-	  if (pos < 0)
-	    pos = ix;
-	  continue;
+	  if (!reg)
+	    continue;
+	  leaf = calloc (YACA_PAGEMAP_LEAFLEN, sizeof (struct yaca_region_st *));
+	  if (!leaf)
+	    YACA_FATAL ("failed to allocate page map leaf - %m");
+	  __atomic_store_n (&yaca_pagemap[topix], leaf, __ATOMIC_RELEASE);
 	}
+      __atomic_store_n (&leaf[slot & (YACA_PAGEMAP_LEAFLEN - 1)], reg,
+			__ATOMIC_RELEASE);
     }
-  for (unsigned ix = 0; ix < h; ix++)
+}
+
+// map a chunk of given size, aligned to some power of two
+static void *
+map_aligned_to (size_t size, size_t align)
+{
+  void *ad = mmap (NULL, size + align,
+		   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		   -1,
+		   (off_t) 0);
+  if (ad == MAP_FAILED)
+    return NULL;
+  if ((uintptr_t) ad % align == 0)
     {
-      struct yaca_region_st *cureg = arr[ix];
-      if (cureg == reg)
-	return;
-      else if (cureg == NULL)
-	{
-	  if (pos < 0)
-	    pos = ix;
-	  arr[pos] = reg;
-	  reg->reg_index = pos;
-	  smallregion.count = count + 1;
-	  return;
-	}
-      else if (cureg == YACA_REGION_EMPTY)
-	{
-	  if (pos < 0)
-	    pos = ix;
-	  continue;
-	}
+      munmap ((char *) ad + size, align);
+      return ad;
     }
-  if (YACA_UNLIKELY (pos < 0))
-    // should not happen
-    YACA_FATAL ("small region array full & corrupted");
-  arr[pos] = reg;
-  reg->reg_index = pos;
-  smallregion.count = count + 1;
+  uintptr_t begreg = ((uintptr_t) ad | (align - 1)) + 1;
+  uintptr_t endreg = begreg + size;
+  munmap ((char *) ad, begreg - (uintptr_t) ad);
+  munmap ((char *) endreg,
+	  (uintptr_t) ((char *) ad + size + align) - endreg);
+  return (void *) begreg;
 }
 
-static void
-reorganize_smallregion (unsigned gap)
+// map an aligned chunk of given power of two size
+static void *
+map_aligned (size_t size)
+{
+  return map_aligned_to (size, size);
+}
+
+
+/** Retired regions are kept in a bounded pool, with their pages given
+   back to the kernel by madvise, and are reused before mapping new
+   ones. When the pool grows above its high watermark it is trimmed
+   down to its low watermark. Both are in megabytes.
+**/
+long yaca_regpool_high_megabytes = 256;
+long yaca_regpool_low_megabytes = 64;
+
+static struct
+{
+  struct yaca_region_st *smallreg;	/* chained thru reg_next */
+  struct yaca_region_st *bigreg;	/* chained thru reg_next */
+  unsigned nbsmall;
+  unsigned nbbig;
+  long megabytes;
+  unsigned long smallhits;
+  unsigned long smallmisses;
+  unsigned long bighits;
+  unsigned long bigmisses;
+} regpool;
+
+// take a region from the pool, with the yaca_memory_mutex held
+static struct yaca_region_st *
+pool_take (bool big)
 {
-  unsigned count = smallregion.count;
-  unsigned oldsize = smallregion.size;
-  struct yaca_region_st **oldarr = smallregion.arr;
-  unsigned long newsize = yaca_prime_after (3 * count / 2 + 40 + gap);
-  if (newsize >= INT_MAX)
-    YACA_FATAL ("too big small region size %ld", (long) newsize);
-  smallregion.count = 0;
-  smallregion.arr = calloc (newsize, sizeof (struct yaca_region_st *));
-  if (!smallregion.arr)
-    YACA_FATAL ("failed to allocate small region array of %d", (int) newsize);
-  smallregion.size = newsize;
-  for (unsigned ix = 0; ix < oldsize; ix++)
+  struct yaca_region_st *reg = big ? regpool.bigreg : regpool.smallreg;
+  if (!reg)
+    {
+      if (big)
+	regpool.bigmisses++;
+      else
+	regpool.smallmisses++;
+      return NULL;
+    }
+  if (big)
     {
-      struct yaca_region_st *cureg = oldarr[ix];
-      if (!cureg || cureg == YACA_REGION_EMPTY)
-	continue;
-      add_smallregion (cureg);
+      regpool.bigreg = reg->reg_next;
+      regpool.nbbig--;
+      regpool.bighits++;
+      regpool.megabytes -= YACA_BIGREGION_SIZE >> 20;
     }
-  free (oldarr);
+  else
+    {
+      regpool.smallreg = reg->reg_next;
+      regpool.nbsmall--;
+      regpool.smallhits++;
+      regpool.megabytes -= YACA_SMALLREGION_SIZE >> 20;
+    }
+  reg->reg_next = NULL;
+  return reg;
 }
 
+// unmap pooled regions till the low watermark, with the mutex held
 static void
-add_bigregion (struct yaca_region_st *reg)
-{
-  unsigned count = bigregion.count;
-  unsigned size = bigregion.size;
-  struct yaca_region_st **arr = bigregion.arr;
-  assert (count + 5 < size && arr != NULL);
-  assert (reg != NULL && reg->reg_magic == YACA_BIGREGION_MAGIC);
-  assert (((uintptr_t) reg % YACA_BIGREGION_SIZE) == 0);
-  int pos = -1;
-  uintptr_t h = ((uintptr_t) reg / YACA_BIGREGION_SIZE) % size;
-  for (unsigned ix = h; ix < size; ix++)
-    {
-      struct yaca_region_st *cureg = arr[ix];
-      if (cureg == reg)
-	return;
-      else if (cureg == NULL)
-	{
-	  if (pos < 0)
-	    pos = ix;
-	  arr[pos] = reg;
-	  reg->reg_index = pos;
-	  bigregion.count = count + 1;
-	  return;
-	}
-      else if (cureg == YACA_REGION_EMPTY)
-	{
-	  if (pos < 0)
-	    pos = ix;
-	  continue;
-	}
-    }
-  for (unsigned ix = 0; ix < h; ix++)
+pool_trim (void)
+{
+  while (regpool.megabytes > yaca_regpool_low_megabytes
+	 && (regpool.bigreg || regpool.smallreg))
     {
-      struct yaca_region_st *cureg = arr[ix];
-      if (cureg == reg)
-	return;
-      else if (cureg == NULL)
+      struct yaca_region_st *reg = NULL;
+      size_t size = 0;
+      if (regpool.bigreg)
 	{
-	  if (pos < 0)
-	    pos = ix;
-	  arr[pos] = reg;
-	  reg->reg_index = pos;
-	  bigregion.count = count + 1;
-	  return;
+	  reg = regpool.bigreg;
+	  regpool.bigreg = reg->reg_next;
+	  regpool.nbbig--;
+	  size = YACA_BIGREGION_SIZE;
 	}
-      else if (cureg == YACA_REGION_EMPTY)
+      else
 	{
-	  if (pos < 0)
-	    pos = ix;
-	  continue;
+	  reg = regpool.smallreg;
+	  regpool.smallreg = reg->reg_next;
+	  regpool.nbsmall--;
+	  size = YACA_SMALLREGION_SIZE;
 	}
+      regpool.megabytes -= size >> 20;
+      if (munmap ((char *) reg, size))
+	YACA_FATAL ("failed to unmap pooled region@%p - %m", (void *) reg);
     }
-  if (YACA_UNLIKELY (pos < 0))
-    // should not happen
-    YACA_FATAL ("big region array full & corrupted");
-  arr[pos] = reg;
-  reg->reg_index = pos;
-  bigregion.count = count + 1;
 }
 
-
-
+// give a retired region to the pool, with the yaca_memory_mutex held
 static void
-reorganize_bigregion (unsigned gap)
+pool_put (struct yaca_region_st *reg, bool big)
 {
-  unsigned count = bigregion.count;
-  unsigned oldsize = bigregion.size;
-  struct yaca_region_st **oldarr = bigregion.arr;
-  unsigned long newsize = yaca_prime_after (3 * count / 2 + 40 + gap);
-  if (newsize >= INT_MAX)
-    YACA_FATAL ("too big big region size %ld", (long) newsize);
-  bigregion.count = 0;
-  bigregion.arr = calloc (newsize, sizeof (struct yaca_region_st *));
-  if (!bigregion.arr)
-    YACA_FATAL ("failed to allocate big region array of %d", (int) newsize);
-  bigregion.size = newsize;
-  for (unsigned ix = 0; ix < oldsize; ix++)
+  size_t size = big ? YACA_BIGREGION_SIZE : YACA_SMALLREGION_SIZE;
+  if (yaca_regpool_high_megabytes < (long) (size >> 20))
+    {
+      if (munmap ((char *) reg, size))
+	YACA_FATAL ("failed to unmap region@%p - %m", (void *) reg);
+      return;
+    }
+  // keep the first page, which holds the pool link, and clear the
+  // rest; MADV_DONTNEED (unlike MADV_FREE) gives zeroed pages back,
+  // so the allocation does not need to clear chunks
+  long pgsiz = sysconf (_SC_PAGESIZE);
+  memset (reg->reg_data, 0, (char *) reg + pgsiz - (char *) reg->reg_data);
+  if (madvise ((char *) reg + pgsiz, size - pgsiz, MADV_DONTNEED))
+    YACA_FATAL ("failed to clear pooled region@%p - %m", (void *) reg);
+  reg->reg_magic = 0;
+  if (big)
     {
-      struct yaca_region_st *cureg = oldarr[ix];
-      if (!cureg || cureg == YACA_REGION_EMPTY)
-	continue;
-      add_bigregion (cureg);
+      reg->reg_next = regpool.bigreg;
+      regpool.bigreg = reg;
+      regpool.nbbig++;
     }
-  free (oldarr);
+  else
+    {
+      reg->reg_next = regpool.smallreg;
+      regpool.smallreg = reg;
+      regpool.nbsmall++;
+    }
+  regpool.megabytes += size >> 20;
+  if (regpool.megabytes > yaca_regpool_high_megabytes)
+    pool_trim ();
 }
 
+void
+yaca_region_pool_stats (struct yaca_regionpool_stats_st *st)
+{
+  if (!st)
+    return;
+  pthread_mutex_lock (&yaca_memory_mutex);
+  st->rps_smallhits = regpool.smallhits;
+  st->rps_smallmisses = regpool.smallmisses;
+  st->rps_bighits = regpool.bighits;
+  st->rps_bigmisses = regpool.bigmisses;
+  st->rps_nbsmall = regpool.nbsmall;
+  st->rps_nbbig = regpool.nbbig;
+  st->rps_megabytes = regpool.megabytes;
+  pthread_mutex_unlock (&yaca_memory_mutex);
+}
 
 
 struct yaca_region_st *
@@ -233,41 +300,25 @@ yaca_new_smallregion (void)
 {
   struct yaca_region_st *reg = NULL;
   pthread_mutex_lock (&yaca_memory_mutex);
-  if (YACA_UNLIKELY (4 * smallregion.count + 50 > 3 * smallregion.size))
-    reorganize_smallregion (smallregion.count / 8 + 20);
-  // allocate the region
-  {
-    void *ad = mmap (NULL, 2 * YACA_SMALLREGION_SIZE,
-		     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
-		     -1,
-		     (off_t) 0);
-    if (ad == MAP_FAILED)
-      YACA_FATAL ("failed to mmap small region - %m");
-    if ((uintptr_t) ad % YACA_SMALLREGION_SIZE == 0)
-      {
-	munmap ((char *) ad + YACA_SMALLREGION_SIZE, YACA_SMALLREGION_SIZE);
-	reg = (struct yaca_region_st *) ad;
-      }
-    else
-      {
-	uintptr_t begreg = ((uintptr_t) ad | (YACA_SMALLREGION_SIZE - 1)) + 1;
-	uintptr_t endreg = begreg + YACA_SMALLREGION_SIZE;
-	munmap ((char *) ad, begreg - (uintptr_t) ad);
-	munmap ((char *) endreg,
-		(uintptr_t) (ad + 2 * YACA_SMALLREGION_SIZE) - endreg);
-	reg = (struct yaca_region_st *) begreg;
-      }
-  }
-  // register the region
-  reg->reg_magic = YACA_SMALLREGION_MAGIC;
-  add_smallregion (reg);
+  // reuse a pooled region, or allocate it
+  reg = pool_take (false);
+  if (!reg)
+    reg = map_aligned (YACA_SMALLREGION_SIZE);
+  if (!reg)
+    YACA_FATAL ("failed to mmap small region - %m");
   // initialize the region
+  reg->reg_magic = YACA_SMALLREGION_MAGIC;
+  reg->reg_index = (uintptr_t) reg >> SMALLREGION_LOG;
   reg->reg_state = 0;
   reg->reg_free = reg->reg_data;
   reg->reg_end = (char *) reg + YACA_SMALLREGION_SIZE;
   if (!reg->reg_end)
     YACA_FATAL ("unlucky small region ending at NIL");
-  allocated_megabytes += YACA_SMALLREGION_SIZE >> 20;
+  // register the region
+  pagemap_set (reg, YACA_SMALLREGION_SIZE, reg);
+  nb_smallregions++;
+  __atomic_fetch_add (&allocated_megabytes,
+		      YACA_SMALLREGION_SIZE >> 20, __ATOMIC_RELAXED);
   goto end;
 end:
   pthread_mutex_unlock (&yaca_memory_mutex);
@@ -280,47 +331,65 @@ yaca_new_bigregion (void)
 {
   struct yaca_region_st *reg = NULL;
   pthread_mutex_lock (&yaca_memory_mutex);
-  if (YACA_UNLIKELY (4 * bigregion.count + 50 > 3 * bigregion.size))
-    reorganize_bigregion (bigregion.count / 8 + 20);
-  // allocate the region
-  {
-    void *ad = mmap (NULL, 2 * YACA_BIGREGION_SIZE,
-		     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
-		     -1,
-		     (off_t) 0);
-    if (ad == MAP_FAILED)
-      YACA_FATAL ("failed to mmap big region - %m");
-    if ((uintptr_t) ad % YACA_BIGREGION_SIZE == 0)
-      {
-	munmap ((char *) ad + YACA_BIGREGION_SIZE, YACA_BIGREGION_SIZE);
-	reg = (struct yaca_region_st *) ad;
-      }
-    else
-      {
-	uintptr_t begreg = ((uintptr_t) ad | (YACA_BIGREGION_SIZE - 1)) + 1;
-	uintptr_t endreg = begreg + YACA_BIGREGION_SIZE;
-	munmap ((char *) ad, begreg - (uintptr_t) ad);
-	munmap ((char *) endreg,
-		(uintptr_t) (ad + 2 * YACA_BIGREGION_SIZE) - endreg);
-	reg = (struct yaca_region_st *) begreg;
-      }
-  }
-  // register the region
-  reg->reg_magic = YACA_BIGREGION_MAGIC;
-  add_bigregion (reg);
+  // reuse a pooled region, or allocate it
+  reg = pool_take (true);
+  if (!reg)
+    reg = map_aligned (YACA_BIGREGION_SIZE);
+  if (!reg)
+    YACA_FATAL ("failed to mmap big region - %m");
   // initialize the region
+  reg->reg_magic = YACA_BIGREGION_MAGIC;
+  reg->reg_index = (uintptr_t) reg >> SMALLREGION_LOG;
   reg->reg_state = 0;
   reg->reg_free = reg->reg_data;
   reg->reg_end = (char *) reg + YACA_BIGREGION_SIZE;
   if (!reg->reg_end)
     YACA_FATAL ("unlucky big region ending at NIL");
-  allocated_megabytes += YACA_BIGREGION_SIZE >> 20;
+  // register the region
+  pagemap_set (reg, YACA_BIGREGION_SIZE, reg);
+  nb_bigregions++;
+  __atomic_fetch_add (&allocated_megabytes,
+		      YACA_BIGREGION_SIZE >> 20, __ATOMIC_RELAXED);
+  goto end;
+end:
+  pthread_mutex_unlock (&yaca_memory_mutex);
+  return reg;
+}
+
+// make a large region for some chunk of data, aligned to small regions
+// so it fills its own slots of the page map; a pinned one is left
+// alone by the GC
+static struct yaca_region_st *
+new_largeregion (size_t datasize, bool pinned)
+{
+  struct yaca_region_st *reg = NULL;
+  size_t size = ((sizeof (struct yaca_region_st) + datasize)
+		 | (YACA_SMALLREGION_SIZE - 1)) + 1;
+  pthread_mutex_lock (&yaca_memory_mutex);
+  reg = map_aligned_to (size, YACA_SMALLREGION_SIZE);
+  if (!reg)
+    YACA_FATAL ("failed to mmap large region of %ld bytes - %m",
+		(long) size);
+  reg->reg_magic = YACA_LARGEREGION_MAGIC;
+  reg->reg_index = (uintptr_t) reg >> SMALLREGION_LOG;
+  reg->reg_state = pinned ? YACA_REGSTATE_PINNED : 0;
+  reg->reg_end = (char *) reg + size;
+  reg->reg_free = reg->reg_end;
+  pagemap_set (reg, size, reg);
+  reg->reg_next = yaca_large_regions;
+  yaca_large_regions = reg;
+  nb_largeregions++;
+  __atomic_fetch_add (&large_allocated_bytes, size, __ATOMIC_RELAXED);
   goto end;
 end:
   pthread_mutex_unlock (&yaca_memory_mutex);
   return reg;
 }
 
+/* A region should be deleted only when nobody uses it anymore, that
+   is during garbage collection, so concurrent yaca_find_region cannot
+   see it disappearing. Large regions are deleted only by the GC, which
+   has unlinked them already. */
 void
 yaca_delete_region (struct yaca_region_st *reg)
 {
@@ -330,33 +399,33 @@ yaca_delete_region (struct yaca_region_st *reg)
   if (reg->reg_magic == YACA_SMALLREGION_MAGIC)
     {
       assert ((uintptr_t) reg % YACA_SMALLREGION_SIZE == 0);
-      assert (smallregion.arr != NULL);
-      assert (reg->reg_index < smallregion.size);
-      assert (smallregion.arr[reg->reg_index] == reg);
-      smallregion.arr[reg->reg_index] = YACA_REGION_EMPTY;
-      smallregion.count--;
-      if (YACA_UNLIKELY
-	  (smallregion.count < smallregion.size / 4
-	   && smallregion.size > 230))
-	reorganize_smallregion (smallregion.count / 8 + 20);
-      if (munmap ((char *) reg, YACA_SMALLREGION_SIZE))
-	YACA_FATAL ("failed to unmap small region@%p - %m", (void *) reg);
-      allocated_megabytes -= YACA_BIGREGION_SIZE >> 20;
+      assert (yaca_find_region (reg) == reg);
+      pagemap_set (reg, YACA_SMALLREGION_SIZE, NULL);
+      nb_smallregions--;
+      pool_put (reg, false);
+      __atomic_fetch_sub (&allocated_megabytes,
+			  YACA_SMALLREGION_SIZE >> 20, __ATOMIC_RELAXED);
     }
   else if (reg->reg_magic == YACA_BIGREGION_MAGIC)
     {
       assert ((uintptr_t) reg % YACA_BIGREGION_SIZE == 0);
-      assert (bigregion.arr != NULL);
-      assert (reg->reg_index < bigregion.size);
-      assert (bigregion.arr[reg->reg_index] == reg);
-      bigregion.arr[reg->reg_index] = YACA_REGION_EMPTY;
-      bigregion.count--;
-      if (YACA_UNLIKELY
-	  (bigregion.count < bigregion.size / 4 && bigregion.size > 120))
-	reorganize_bigregion (bigregion.count / 8 + 20);
-      if (munmap ((char *) reg, YACA_BIGREGION_SIZE))
-	YACA_FATAL ("failed to unmap big region@%p - %m", (void *) reg);
-      allocated_megabytes -= YACA_BIGREGION_SIZE >> 20;
+      assert (yaca_find_region (reg) == reg);
+      pagemap_set (reg, YACA_BIGREGION_SIZE, NULL);
+      nb_bigregions--;
+      pool_put (reg, true);
+      __atomic_fetch_sub (&allocated_megabytes,
+			  YACA_BIGREGION_SIZE >> 20, __ATOMIC_RELAXED);
+    }
+  else if (reg->reg_magic == YACA_LARGEREGION_MAGIC)
+    {
+      size_t size = (char *) reg->reg_end - (char *) reg;
+      assert ((uintptr_t) reg % YACA_SMALLREGION_SIZE == 0);
+      assert (yaca_find_region (reg) == reg);
+      pagemap_set (reg, size, NULL);
+      nb_largeregions--;
+      __atomic_fetch_sub (&large_allocated_bytes, size, __ATOMIC_RELAXED);
+      if (munmap ((char *) reg, size))
+	YACA_FATAL ("failed to unmap large region@%p - %m", (void *) reg);
     }
   goto end;
 end:
@@ -364,172 +433,1252 @@ end:
 }
 
 
+// find the region containing a pointer, without any locking
 struct yaca_region_st *
 yaca_find_region (void *ptr)
 {
-  struct yaca_region_st *reg = NULL;
-  if (!ptr || (uintptr_t) ptr < YACA_SMALLREGION_SIZE
-      || (uintptr_t) ptr > UINTPTR_MAX - YACA_SMALLREGION_SIZE)
+  uintptr_t slot = (uintptr_t) ptr >> SMALLREGION_LOG;
+  if (!ptr || YACA_UNLIKELY (slot == 0
+			     || slot >= (YACA_PAGEMAP_TOPLEN
+					 << YACA_PAGEMAP_LEAFBITS)))
     return NULL;
-  pthread_mutex_lock (&yaca_memory_mutex);
-  // is it inside a small region?
-  {
-    void *alptr = (void *) ((uintptr_t) ptr & ~(YACA_SMALLREGION_SIZE - 1));
-    unsigned size = smallregion.size;
-    struct yaca_region_st **arr = smallregion.arr;
-    assert (size > 2);
-    assert (arr != NULL);
-    uintptr_t h = ((uintptr_t) ptr / YACA_SMALLREGION_SIZE) % size;
-    for (unsigned ix = h; ix < size; ix++)
-      {
-	struct yaca_region_st *cureg = arr[ix];
-	if ((void *) cureg == alptr)
-	  {
-	    reg = cureg;
-	    break;
-	  }
-	else if (cureg == NULL)
-	  break;
-      };
-    for (unsigned ix = 0; ix < h; ix++)
-      {
-	struct yaca_region_st *cureg = arr[ix];
-	if ((void *) cureg == alptr)
-	  {
-	    reg = cureg;
-	    break;
-	  }
-	else if (cureg == NULL)
-	  break;
-      };
-  }
-  // is it inside a big region?
-  if (!reg)
+  struct yaca_region_st **leaf =
+    __atomic_load_n (&yaca_pagemap[slot >> YACA_PAGEMAP_LEAFBITS],
+		     __ATOMIC_ACQUIRE);
+  if (!leaf)
+    return NULL;
+  return __atomic_load_n (&leaf[slot & (YACA_PAGEMAP_LEAFLEN - 1)],
+			  __ATOMIC_ACQUIRE);
+}
+
+
+// hand a chain of regions to the collector, with yaca_workalloc_mutex
+// held
+static void
+tlab_release_chain (struct yaca_region_st *reg)
+{
+  struct yaca_region_st *next = NULL;
+  for (; reg != NULL; reg = next)
     {
-      void *alptr = (void *) ((uintptr_t) ptr & ~(YACA_BIGREGION_SIZE - 1));
-      unsigned size = bigregion.size;
-      struct yaca_region_st **arr = bigregion.arr;
-      assert (size > 2);
-      assert (arr != NULL);
-      uintptr_t h = ((uintptr_t) ptr / YACA_BIGREGION_SIZE) % size;
-      for (unsigned ix = h; ix < size; ix++)
-	{
-	  struct yaca_region_st *cureg = arr[ix];
-	  if ((void *) cureg == alptr)
-	    {
-	      reg = cureg;
-	      break;
-	    }
-	  else if (cureg == NULL)
-	    goto end;
-	};
-      for (unsigned ix = 0; ix < h; ix++)
-	{
-	  struct yaca_region_st *cureg = arr[ix];
-	  if ((void *) cureg == alptr)
-	    {
-	      reg = cureg;
-	      break;
-	    }
-	  else if (cureg == NULL)
-	    goto end;
-	};
+      next = reg->reg_next;
+      reg->reg_next = yaca_released_regions;
+      yaca_released_regions = reg;
     }
+}
+
+// unpin the large regions of a buffer
+static void
+tlab_unpin_large (struct yaca_tlab_st *tl)
+{
+  if (tl->tlab_nblarge == 0)
+    return;
+  // the collector reads their state with the memory mutex held
+  pthread_mutex_lock (&yaca_memory_mutex);
+  for (unsigned ix = 0; ix < tl->tlab_nblarge; ix++)
+    __atomic_fetch_and (&tl->tlab_large[ix]->reg_state,
+			~YACA_REGSTATE_PINNED, __ATOMIC_RELAXED);
+  pthread_mutex_unlock (&yaca_memory_mutex);
+  tl->tlab_nblarge = 0;
+}
+
+// at thread exit, hand all the regions of its buffer to the collector
+static void
+tlab_release (void *d)
+{
+  struct yaca_tlab_st *tl = d;
+  tlab_unpin_large (tl);
+  pthread_mutex_lock (&yaca_workalloc_mutex);
+  for (struct yaca_tlab_st ** ptl = &yaca_tlab_list; *ptl;
+       ptl = &(*ptl)->tlab_next)
+    if (*ptl == tl)
+      {
+	*ptl = tl->tlab_next;
+	break;
+      }
+  nb_tlabs--;
+  nb_exitedalloc += tl->tlab_nballoc;
+  tlab_release_chain (tl->tlab_smallreg);
+  tlab_release_chain (tl->tlab_bigreg);
   goto end;
 end:
-  pthread_mutex_unlock (&yaca_memory_mutex);
-  return reg;
+  pthread_mutex_unlock (&yaca_workalloc_mutex);
+  free (tl->tlab_large);
+  free (tl);
 }
 
+void
+yaca_work_safepoint (void)
+{
+  struct yaca_tlab_st *tl = yaca_this_tlab;
+  if (!tl)
+    return;
+  assert (!yaca_this_worker || yaca_this_worker->worker_num <= 0);
+  tlab_unpin_large (tl);
+  if ((!tl->tlab_smallreg || !tl->tlab_smallreg->reg_next)
+      && (!tl->tlab_bigreg || !tl->tlab_bigreg->reg_next))
+    return;
+  // keep allocating in the current regions, which stay pinned
+  pthread_mutex_lock (&yaca_workalloc_mutex);
+  if (tl->tlab_smallreg)
+    {
+      tlab_release_chain (tl->tlab_smallreg->reg_next);
+      tl->tlab_smallreg->reg_next = NULL;
+    }
+  if (tl->tlab_bigreg)
+    {
+      tlab_release_chain (tl->tlab_bigreg->reg_next);
+      tl->tlab_bigreg->reg_next = NULL;
+    }
+  pthread_mutex_unlock (&yaca_workalloc_mutex);
+}
 
 void
 yaca_initialize_memgc (void)
 {
-  {
-    unsigned siz = yaca_prime_after (220);
-    memset (&smallregion, 0, sizeof (smallregion));
-    smallregion.arr = calloc (siz, sizeof (struct yaca_region_st *));
-    if (!smallregion.arr)
-      YACA_FATAL ("failed to allocate small region array (%d) - %m",
-		  (int) siz);
-    smallregion.size = siz;
-  }
-  {
-    unsigned siz = yaca_prime_after (60);
-    memset (&bigregion, 0, sizeof (bigregion));
-    bigregion.arr = calloc (siz, sizeof (struct yaca_region_st *));
-    if (!bigregion.arr)
-      YACA_FATAL ("failed to allocate big region array (%d) - %m", (int) siz);
-    bigregion.size = siz;
-  }
-  // initialize the common regions
-  yaca_common_smallreg = yaca_new_smallregion ();
-  yaca_common_bigreg = yaca_new_bigregion ();
+  if (pthread_key_create (&yaca_tlab_key, tlab_release))
+    YACA_FATAL ("failed to create thread-local allocation key - %m");
 }
 
 long
 yaca_allocated_megabytes (void)
 {
-  return allocated_megabytes;
+  return __atomic_load_n (&allocated_megabytes, __ATOMIC_RELAXED);
+}
+
+long
+yaca_large_allocated_megabytes (void)
+{
+  return __atomic_load_n (&large_allocated_bytes, __ATOMIC_RELAXED) >> 20;
 }
 
 
 
+/** Every chunk given by yaca_work_allocate starts with a small
+   header, so the copying collector knows its size and can leave in it
+   the address of its new copy. Pointers to region data should point to
+   the start of the chunk data, as given by yaca_work_allocate.
+**/
+#define YACA_CHUNK_MAGIC 773937463	/*0x2e215937 */
+struct yaca_chunk_st
+{
+  uint32_t chk_magic;		/* always YACA_CHUNK_MAGIC */
+  uint32_t chk_size;		/* total size, including this header */
+  void *chk_forward;		/* data of the new copy, during GC */
+  long long chk_data[] __attribute__ ((aligned (YACA_MINALIGNMENT)));
+};
+
+// ask for a collection when the heap grew enough
+static void gc_pace (void);
+
+// allocate in the first region of a chain, pushing a new region on
+// it when full; then *pnewreg is set, and the caller should call
+// gc_pace when it holds no lock. An empty chain, e.g. just after a
+// collection, is refilled silently.
+static inline struct yaca_chunk_st *
+allocate_in_chain (struct yaca_region_st **pchain, unsigned fullsiz,
+		   bool *pnewreg)
+{
+  struct yaca_chunk_st *chk = yaca_allocate_in_region (*pchain, fullsiz);
+  if (YACA_UNLIKELY (chk == NULL))
+    {
+      struct yaca_region_st *newreg =
+	(fullsiz < YACA_SMALLREGION_SIZE / 2)
+	? yaca_new_smallregion () : yaca_new_bigregion ();
+      __atomic_fetch_add (&nb_lockedalloc, 1, __ATOMIC_RELAXED);
+      newreg->reg_next = *pchain;
+      *pchain = newreg;
+      chk = yaca_allocate_in_region (newreg, fullsiz);
+      if (newreg->reg_next)
+	*pnewreg = true;
+    }
+  return chk;
+}
+
+// give the buffer of the current non-worker thread, making it if needed
+static struct yaca_tlab_st *
+this_tlab (void)
+{
+  struct yaca_tlab_st *tl = yaca_this_tlab;
+  if (YACA_LIKELY (tl != NULL))
+    return tl;
+  tl = calloc (1, sizeof (*tl));
+  if (!tl)
+    YACA_FATAL ("failed to allocate thread-local allocation buffer - %m");
+  pthread_mutex_lock (&yaca_workalloc_mutex);
+  tl->tlab_next = yaca_tlab_list;
+  yaca_tlab_list = tl;
+  nb_tlabs++;
+  pthread_mutex_unlock (&yaca_workalloc_mutex);
+  pthread_setspecific (yaca_tlab_key, tl);
+  yaca_this_tlab = tl;
+  return tl;
+}
+
 // allocate from a worker (preferably), and ask for GC when needed
 void *
 yaca_work_allocate (unsigned siz)
 {
-  struct yaca_region_st *reg = NULL;
+  struct yaca_worker_st *wrk = yaca_this_worker;
+  struct yaca_chunk_st *chk = NULL;
+  bool newreg = false;
   if (YACA_UNLIKELY (siz == 0))
     return NULL;
-  if (YACA_LIKELY (yaca_this_worker
-		   && siz < YACA_SMALLREGION_SIZE / 2
-		   && yaca_this_worker->worker_num > 0
-		   && yaca_this_worker->worker_magic == YACA_WORKER_MAGIC
-		   && (reg = yaca_this_worker->worker_region) != NULL))
-    {
-      void *p = yaca_allocate_in_region (reg, siz);
-      if (p)
-	return p;
-      struct yaca_region_st *newreg = yaca_new_smallregion ();
-      newreg->reg_next = reg;
-      yaca_this_worker->worker_region = newreg;
-      yaca_should_garbage_collect ();
+  unsigned fullsiz = ((siz + sizeof (struct yaca_chunk_st))
+		      | (YACA_MINALIGNMENT - 1)) + 1;
+  if (YACA_UNLIKELY (fullsiz < siz))
+    YACA_FATAL ("too big work allocation of %u bytes", siz);
+  if (YACA_UNLIKELY (fullsiz >= YACA_BIGREGION_SIZE / 2))
+    {
+      bool worker = wrk && wrk->worker_num > 0;
+      struct yaca_tlab_st *tl = worker ? NULL : this_tlab ();
+      struct yaca_region_st *reg = new_largeregion (fullsiz, !worker);
+      chk = (struct yaca_chunk_st *) reg->reg_data;
+      __atomic_fetch_add (&nb_largealloc, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add (&nb_lockedalloc, 1, __ATOMIC_RELAXED);
+      newreg = true;
+      if (tl)
+	{
+	  // remember it, to unpin it at our next safepoint
+	  if (tl->tlab_nblarge >= tl->tlab_sizlarge)
+	    {
+	      unsigned newsiz = 2 * tl->tlab_sizlarge + 4;
+	      struct yaca_region_st **newarr =
+		realloc (tl->tlab_large,
+			 newsiz * sizeof (struct yaca_region_st *));
+	      if (!newarr)
+		YACA_FATAL ("failed to grow pinned large regions to %u",
+			    newsiz);
+	      tl->tlab_large = newarr;
+	      tl->tlab_sizlarge = newsiz;
+	    }
+	  tl->tlab_large[tl->tlab_nblarge++] = reg;
+	}
+    }
+  else if (YACA_LIKELY (wrk && wrk->worker_num > 0
+			&& wrk->worker_magic == YACA_WORKER_MAGIC))
+    {
+      // workers own their regions, since they collect together
+      chk = allocate_in_chain ((fullsiz < YACA_SMALLREGION_SIZE / 2)
+			       ? &wrk->worker_region
+			       : &wrk->worker_bigregion, fullsiz, &newreg);
+      wrk->worker_nballoc++;
     }
   else
     {
-      void *ad = NULL;
-      pthread_mutex_lock (&yaca_workalloc_mutex);
-      if (siz < YACA_SMALLREGION_SIZE / 2)
+      struct yaca_tlab_st *tl = this_tlab ();
+      chk = allocate_in_chain ((fullsiz < YACA_SMALLREGION_SIZE / 2)
+			       ? &tl->tlab_smallreg
+			       : &tl->tlab_bigreg, fullsiz, &newreg);
+      __atomic_store_n (&tl->tlab_nballoc, tl->tlab_nballoc + 1,
+			__ATOMIC_RELAXED);
+    }
+  if (YACA_UNLIKELY (newreg))
+    gc_pace ();
+  if (!chk)
+    return NULL;
+  chk->chk_magic = YACA_CHUNK_MAGIC;
+  chk->chk_size = fullsiz;
+  return chk->chk_data;
+}
+
+void
+yaca_alloc_stats (struct yaca_alloc_stats_st *st)
+{
+  if (!st)
+    return;
+  memset (st, 0, sizeof (*st));
+  for (unsigned wix = 1; wix <= yaca_nb_workers; wix++)
+    st->als_allocations += yaca_worktab[wix].worker_nballoc;
+  pthread_mutex_lock (&yaca_workalloc_mutex);
+  for (struct yaca_tlab_st * tl = yaca_tlab_list; tl; tl = tl->tlab_next)
+    st->als_allocations += __atomic_load_n (&tl->tlab_nballoc,
+					    __ATOMIC_RELAXED);
+  st->als_allocations += nb_exitedalloc;
+  st->als_allocations += __atomic_load_n (&nb_largealloc, __ATOMIC_RELAXED);
+  st->als_locked = __atomic_load_n (&nb_lockedalloc, __ATOMIC_RELAXED);
+  st->als_nbtlabs = nb_tlabs;
+  pthread_mutex_unlock (&yaca_workalloc_mutex);
+}
+
+
+/** The collector runs in parallel in every worker thread, once they
+   all reached the yawrk_start_gc state, so only workers should keep
+   pointers to region data across their tasks.
+
+   It first marks the items reachable from the roots: the items of
+   persistent spaces and the task items of the agenda. Grey items are
+   kept in packets, which markers share thru a common list. The
+   typr_gcscan routine of a scanned item calls yaca_gc_mark_item for
+   each item it references. In concurrent mode, most of that marking
+   is done by the GC thread while the workers still run tasks; a
+   touched item then gets its references snapshotted before being
+   modified. Since tasks may also reach items by their id, every item
+   touched during the cycle is scanned again in the final remark, done
+   by all the workers.
+
+   The items which were not reached are then destroyed by the
+   workers, each sweeping its own range of ids, and items made
+   meanwhile are allocated black. The items which a pinned thread
+   other than the workers made or found by id are recorded, and marked
+   as roots till it unpins, so it should make them reachable before.
+   Such a thread finding by id an unreached item while the sweep runs
+   gets NULL, since the item is being destroyed.
+
+   Then it copies the region data of the workers, and the regions
+   handed by the other threads at their safepoints; the other regions
+   of these threads are pinned, neither copied nor freed, since they
+   are not stopped. But they may not hold items or region data while
+   the workers copy: the copy waits till they are all unpinned, and
+   they cannot pin again before its end. The id space of items is
+   split in one range per worker. Each worker scans the items of its range by
+   blocks, and their typr_gcscan routine forwards the region data they
+   reference into the to-space regions of that worker. When its own
+   range is exhausted, a worker steals blocks from the ranges of the
+   others. At last, all the old regions go back to the region layer,
+   and each worker continues allocating in its to-space. Large regions
+   are never copied: forwarding into one just flags it as live, and
+   the unflagged ones are unmapped.
+**/
+#define YACA_GC_BLOCK 256	/* number of ids scanned at once */
+struct yaca_gcpart_st
+{
+  yaca_id_t gcp_next;		/* next id to scan, atomically updated */
+  yaca_id_t gcp_end;		/* end of the id range */
+  struct yaca_region_st *gcp_smallto;	/* to-space small regions */
+  struct yaca_region_st *gcp_bigto;	/* to-space big regions */
+  unsigned long gcp_copied;	/* bytes copied by the worker */
+} __attribute__ ((aligned (64)));
+
+enum yaca_gcmode_en yaca_gc_mode = yagc_stoptheworld;
+int yaca_gc_marking;
+
+static struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  unsigned arrived;		/* number of workers at the barrier */
+  unsigned long barriergen;	/* incremented when all arrived */
+  unsigned long nbcollections;
+  bool cyclerunning;		/* a concurrent cycle was started */
+  bool markrequested;		/* the GC thread should start marking */
+  bool concmarked;		/* the GC thread did mark concurrently */
+  struct yaca_region_st *fromspace;	/* old regions, thru reg_next */
+  unsigned nbfrom;
+  unsigned nbtouched;		/* remembered items since previous GC */
+  unsigned long nbmarked;	/* live items, atomically updated */
+  unsigned long nbswept;	/* destroyed items, atomically updated */
+  unsigned nextstripe;		/* next tuple stripe to fix up, atomically
+				   updated */
+  struct timespec stopreqtime;	/* when the workers were asked to stop */
+  struct timespec startime;	/* when they all stopped */
+  double lastpause;		/* in seconds */
+  double lastsafepoint;		/* seconds from stop request to start */
+  struct yaca_gcpart_st part[YACA_MAX_WORKERS + 1];	/* part#0 unused */
+} gcstate =
+{
+PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+/** The pacer asks for a collection when the heap, i.e. the small, big
+   and large regions, reaches a trigger. After each collection the
+   trigger is computed from the live heap: it should grow by
+   yaca_gc_growth_factor, but never beyond yaca_gc_heapcap_megabytes
+   if positive. The trigger is lowered by what is allocated, at the
+   average allocation rate, between a request and the end of its
+   collection, so that a concurrent cycle can end before the target
+   is reached.
+**/
+#define YACA_GC_MIN_HEADROOM 16	/* megabytes of growth between collections */
+#define YACA_GC_PACER_WEIGHT 0.25	/* weight of the latest sample */
+double yaca_gc_growth_factor = 2.0;
+long yaca_gc_heapcap_megabytes;
+
+static struct
+{
+  long trigger;			/* heap megabytes, atomically read */
+  int requested;		/* atomically set by the first requester */
+  long live;			/* heap megabytes after the last collection */
+  long heapatstart;		/* heap megabytes when it started */
+  double allocrate;		/* average megabytes per second */
+  double delay;			/* average seconds from request to end */
+  struct timespec requestime;
+  struct timespec lastend;
+} gcpacer =
+{
+YACA_GC_MIN_HEADROOM};
+
+/** A thread other than the workers may hold items and region data only
+   while it is pinned, see yaca_items_pin. The workers do not start
+   copying till such threads unpinned, and their outermost pins wait
+   till the copy ends, so these threads never see moved data.
+**/
+static struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  unsigned nbpinned;		/* pinned threads other than the workers */
+  bool copying;			/* the workers are copying */
+} gcgate =
+{
+PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+void
+yaca_gc_enter_pinned (void)
+{
+  pthread_mutex_lock (&gcgate.mutex);
+  while (gcgate.copying)
+    pthread_cond_wait (&gcgate.cond, &gcgate.mutex);
+  gcgate.nbpinned++;
+  pthread_mutex_unlock (&gcgate.mutex);
+}
+
+void
+yaca_gc_leave_pinned (void)
+{
+  pthread_mutex_lock (&gcgate.mutex);
+  assert (gcgate.nbpinned > 0);
+  if (--gcgate.nbpinned == 0 && gcgate.copying)
+    pthread_cond_broadcast (&gcgate.cond);
+  pthread_mutex_unlock (&gcgate.mutex);
+}
+
+// in every worker, wait till the other threads unpinned before copying
+static void
+gc_close_gate (void)
+{
+  pthread_mutex_lock (&gcgate.mutex);
+  gcgate.copying = true;
+  while (gcgate.nbpinned > 0)
+    pthread_cond_wait (&gcgate.cond, &gcgate.mutex);
+  pthread_mutex_unlock (&gcgate.mutex);
+}
+
+// serially, once copied, let the other threads pin again
+static void
+gc_open_gate (void)
+{
+  pthread_mutex_lock (&gcgate.mutex);
+  gcgate.copying = false;
+  pthread_cond_broadcast (&gcgate.cond);
+  pthread_mutex_unlock (&gcgate.mutex);
+}
+
+// note when the workers are first asked to stop
+static void
+gc_note_stop_request (void)
+{
+  pthread_mutex_lock (&gcstate.mutex);
+  if (gcstate.stopreqtime.tv_sec == 0)
+    clock_gettime (CLOCK_MONOTONIC, &gcstate.stopreqtime);
+  pthread_mutex_unlock (&gcstate.mutex);
+}
+
+static inline long
+gc_heap_megabytes (void)
+{
+  return yaca_allocated_megabytes () + yaca_large_allocated_megabytes ();
+}
+
+static void
+gc_pace (void)
+{
+  long heap = gc_heap_megabytes ();
+  if (YACA_LIKELY (heap < __atomic_load_n (&gcpacer.trigger,
+					   __ATOMIC_RELAXED)))
+    return;
+  if (__atomic_exchange_n (&gcpacer.requested, 1, __ATOMIC_ACQ_REL))
+    return;
+  clock_gettime (CLOCK_MONOTONIC, &gcpacer.requestime);
+  if (yaca_gc_mode == yagc_stoptheworld)
+    gc_note_stop_request ();
+  yaca_should_garbage_collect ();
+}
+
+// serially compute the next trigger at the end of a collection
+static void
+gc_pacer_update (const struct timespec *endtime)
+{
+  long live = gc_heap_megabytes ();
+  if (gcpacer.lastend.tv_sec > 0)
+    {
+      double elapsed = (endtime->tv_sec - gcpacer.lastend.tv_sec)
+	+ 1.0e-9 * (endtime->tv_nsec - gcpacer.lastend.tv_nsec);
+      long grown = gcpacer.heapatstart - gcpacer.live;
+      if (elapsed > 0.0 && grown > 0)
+	gcpacer.allocrate += YACA_GC_PACER_WEIGHT
+	  * (grown / elapsed - gcpacer.allocrate);
+    }
+  if (gcpacer.requested && gcpacer.requestime.tv_sec > 0)
+    {
+      double delay = (endtime->tv_sec - gcpacer.requestime.tv_sec)
+	+ 1.0e-9 * (endtime->tv_nsec - gcpacer.requestime.tv_nsec);
+      if (delay > 0.0)
+	gcpacer.delay += YACA_GC_PACER_WEIGHT * (delay - gcpacer.delay);
+    }
+  long target = (long) (live * yaca_gc_growth_factor);
+  if (target < live + YACA_GC_MIN_HEADROOM)
+    target = live + YACA_GC_MIN_HEADROOM;
+  if (yaca_gc_heapcap_megabytes > 0 && target > yaca_gc_heapcap_megabytes)
+    {
+      target = yaca_gc_heapcap_megabytes;
+      if (live >= target)
+	YACA_SYSLOG (LOG_WARNING,
+		     "live heap of %ld megabytes reached the cap of %ld",
+		     live, yaca_gc_heapcap_megabytes);
+    }
+  long trigger = target - (long) (gcpacer.allocrate * gcpacer.delay);
+  if (trigger < live + 1)
+    trigger = live + 1;
+  gcpacer.live = live;
+  gcpacer.lastend = *endtime;
+  __atomic_store_n (&gcpacer.trigger, trigger, __ATOMIC_RELAXED);
+  __atomic_store_n (&gcpacer.requested, 0, __ATOMIC_RELEASE);
+}
+
+long
+yaca_gc_trigger_megabytes (void)
+{
+  return __atomic_load_n (&gcpacer.trigger, __ATOMIC_RELAXED);
+}
+
+/** A record of the last collections is kept, in a ring under the
+   gcstate mutex, for telemetry. It is given as JSON, and dumped to
+   syslog by the GC thread when SIGUSR1 is received.
+**/
+#define YACA_GC_NB_RECORDS 128	/* also the window of pause quantiles */
+struct yaca_gcrecord_st
+{
+  unsigned long gcr_num;	/* collection number */
+  double gcr_endtime;		/* real time at its end */
+  double gcr_pause;		/* seconds with every worker stopped */
+  double gcr_safepoint;		/* seconds to stop every worker */
+  unsigned long gcr_copied;	/* bytes copied */
+  unsigned gcr_freed;		/* regions freed */
+  unsigned long gcr_live;	/* live items */
+  unsigned long gcr_swept;	/* destroyed items */
+  long gcr_heap;		/* heap megabytes after it */
+};
+static struct yaca_gcrecord_st gcrecords[YACA_GC_NB_RECORDS];
+static bool gc_telemetry_requested;	/* under gcstate.mutex */
+// posted by the SIGUSR1 handler, which cannot signal a condition
+static sem_t gc_telemetry_sem;
+
+static int
+gc_cmp_double (const void *p1, const void *p2)
+{
+  double d1 = *(const double *) p1, d2 = *(const double *) p2;
+  return (d1 > d2) - (d1 < d2);
+}
+
+json_t *
+yaca_gc_telemetry_json (void)
+{
+  double pauses[YACA_GC_NB_RECORDS];
+  json_t *jrecords = json_array ();
+  json_t *jtel = json_object ();
+  pthread_mutex_lock (&gcstate.mutex);
+  unsigned long nbgc = gcstate.nbcollections;
+  unsigned nbrec = (nbgc < YACA_GC_NB_RECORDS) ? nbgc : YACA_GC_NB_RECORDS;
+  // the records, oldest first
+  for (unsigned long num = nbgc - nbrec + 1; num <= nbgc; num++)
+    {
+      struct yaca_gcrecord_st *rec = gcrecords + num % YACA_GC_NB_RECORDS;
+      json_t *jrec = json_object ();
+      json_object_set_new (jrec, "num", json_integer (rec->gcr_num));
+      json_object_set_new (jrec, "time", json_real (rec->gcr_endtime));
+      json_object_set_new (jrec, "pause", json_real (rec->gcr_pause));
+      json_object_set_new (jrec, "safepoint",
+			   json_real (rec->gcr_safepoint));
+      json_object_set_new (jrec, "copied", json_integer (rec->gcr_copied));
+      json_object_set_new (jrec, "freed", json_integer (rec->gcr_freed));
+      json_object_set_new (jrec, "live", json_integer (rec->gcr_live));
+      json_object_set_new (jrec, "swept", json_integer (rec->gcr_swept));
+      json_object_set_new (jrec, "heap", json_integer (rec->gcr_heap));
+      json_array_append_new (jrecords, jrec);
+      pauses[num - (nbgc - nbrec + 1)] = rec->gcr_pause;
+    }
+  pthread_mutex_unlock (&gcstate.mutex);
+  qsort (pauses, nbrec, sizeof (double), gc_cmp_double);
+  json_t *jpauses = json_object ();
+  json_object_set_new (jpauses, "count", json_integer (nbrec));
+  json_object_set_new (jpauses, "p50",
+		       json_real (nbrec ? pauses[nbrec / 2] : 0.0));
+  json_object_set_new (jpauses, "p99",
+		       json_real (nbrec ? pauses[(nbrec * 99) / 100] : 0.0));
+  json_object_set_new (jpauses, "max",
+		       json_real (nbrec ? pauses[nbrec - 1] : 0.0));
+  json_object_set_new (jtel, "collections", json_integer (nbgc));
+  json_object_set_new (jtel, "heap_megabytes",
+		       json_integer (yaca_allocated_megabytes ()));
+  json_object_set_new (jtel, "large_megabytes",
+		       json_integer (yaca_large_allocated_megabytes ()));
+  json_object_set_new (jtel, "trigger_megabytes",
+		       json_integer (yaca_gc_trigger_megabytes ()));
+  json_object_set_new (jtel, "pauses", jpauses);
+  json_object_set_new (jtel, "records", jrecords);
+  return jtel;
+}
+
+static void
+gc_usr1_handler (int sig)
+{
+  assert (sig == SIGUSR1);
+  sem_post (&gc_telemetry_sem);
+}
+
+// wake the GC thread for each SIGUSR1
+static void *
+gc_telemetry_waiter (void *d)
+{
+  assert (d == NULL);
+  for (;;)
+    {
+      if (sem_wait (&gc_telemetry_sem))
+	{
+	  if (errno == EINTR)
+	    continue;
+	  YACA_FATAL ("failed to wait for telemetry requests - %m");
+	}
+      pthread_mutex_lock (&gcstate.mutex);
+      gc_telemetry_requested = true;
+      pthread_cond_broadcast (&gcstate.cond);
+      pthread_mutex_unlock (&gcstate.mutex);
+    }
+  return NULL;
+}
+
+static void
+gc_dump_telemetry (void)
+{
+  json_t *jtel = yaca_gc_telemetry_json ();
+  char *str = json_dumps (jtel, JSON_COMPACT);
+  if (str)
+    YACA_SYSLOG (LOG_INFO, "garbage collector telemetry %s", str);
+  free (str);
+  json_decref (jtel);
+}
+
+#define YACA_MARKPACKET_LEN 510
+struct yaca_markpacket_st
+{
+  struct yaca_markpacket_st *mpk_next;
+  unsigned mpk_len;
+  struct yaca_item_st *mpk_items[YACA_MARKPACKET_LEN];
+};
+
+static struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct yaca_markpacket_st *full;	/* packets of grey items */
+  struct yaca_markpacket_st *empty;	/* recycled packets */
+  unsigned nbmarkers;		/* threads draining the grey packets */
+  unsigned nbidle;		/* idle draining threads */
+  bool done;			/* all grey packets have been drained */
+  unsigned nbsnapshots;		/* snapshots in progress, atomically updated */
+} gcmark =
+{
+PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+// the packet where this thread pushes grey items
+static __thread struct yaca_markpacket_st *gc_greypacket;
+
+
+// wait till every worker reached that barrier; the last one arriving
+// runs the serial function before releasing the others
+static void
+gc_barrier (void (*serialfun) (void))
+{
+  pthread_mutex_lock (&gcstate.mutex);
+  unsigned long gen = gcstate.barriergen;
+  if (++gcstate.arrived == yaca_nb_workers)
+    {
+      if (serialfun)
+	(*serialfun) ();
+      gcstate.arrived = 0;
+      gcstate.barriergen = gen + 1;
+      pthread_cond_broadcast (&gcstate.cond);
+    }
+  else
+    while (gcstate.barriergen == gen)
+      pthread_cond_wait (&gcstate.cond, &gcstate.mutex);
+  pthread_mutex_unlock (&gcstate.mutex);
+}
+
+// split the id space in one range per worker
+static void
+gc_split_ids (void)
+{
+  yaca_id_t bound = yaca_items_bound ();
+  unsigned nbw = yaca_nb_workers;
+  for (unsigned wix = 1; wix <= nbw; wix++)
+    {
+      struct yaca_gcpart_st *part = gcstate.part + wix;
+      part->gcp_next = 1 + (uint64_t) (bound - 1) * (wix - 1) / nbw;
+      part->gcp_end = 1 + (uint64_t) (bound - 1) * wix / nbw;
+    }
+}
+
+// apply a function to the blocks of items of our range given by a
+// lister, like yaca_items_in_range, then steal from other ranges
+static void
+gc_parallel_items (unsigned (*lister) (yaca_id_t, yaca_id_t,
+				       struct yaca_item_st **),
+		   void (*fun) (struct yaca_item_st **, unsigned))
+{
+  int num = yaca_this_worker->worker_num;
+  unsigned nbw = yaca_nb_workers;
+  struct yaca_item_st *itembuf[YACA_GC_BLOCK];
+  assert (num > 0 && num <= (int) nbw);
+  for (unsigned k = 0; k < nbw; k++)
+    {
+      struct yaca_gcpart_st *part = gcstate.part + 1 + (num - 1 + k) % nbw;
+      for (;;)
+	{
+	  yaca_id_t lo = __atomic_fetch_add (&part->gcp_next, YACA_GC_BLOCK,
+					     __ATOMIC_RELAXED);
+	  if (lo >= part->gcp_end)
+	    break;
+	  yaca_id_t hi = lo + YACA_GC_BLOCK;
+	  if (hi > part->gcp_end)
+	    hi = part->gcp_end;
+	  unsigned nb = (*lister) (lo, hi, itembuf);
+	  if (nb > 0)
+	    (*fun) (itembuf, nb);
+	}
+    }
+}
+
+
+static struct yaca_markpacket_st *
+gc_get_packet (void)
+{
+  struct yaca_markpacket_st *pk = NULL;
+  pthread_mutex_lock (&gcmark.mutex);
+  pk = gcmark.empty;
+  if (pk)
+    gcmark.empty = pk->mpk_next;
+  pthread_mutex_unlock (&gcmark.mutex);
+  if (!pk)
+    {
+      pk = malloc (sizeof (struct yaca_markpacket_st));
+      if (!pk)
+	YACA_FATAL ("failed to allocate mark packet - %m");
+    }
+  pk->mpk_next = NULL;
+  pk->mpk_len = 0;
+  return pk;
+}
+
+// give a packet to the other markers, or recycle it if empty
+static void
+gc_publish_packet (struct yaca_markpacket_st *pk)
+{
+  if (!pk)
+    return;
+  pthread_mutex_lock (&gcmark.mutex);
+  if (pk->mpk_len > 0)
+    {
+      pk->mpk_next = gcmark.full;
+      gcmark.full = pk;
+      pthread_cond_signal (&gcmark.cond);
+    }
+  else
+    {
+      pk->mpk_next = gcmark.empty;
+      gcmark.empty = pk;
+    }
+  pthread_mutex_unlock (&gcmark.mutex);
+}
+
+static void
+gc_push_grey (struct yaca_item_st *itm)
+{
+  if (!gc_greypacket)
+    gc_greypacket = gc_get_packet ();
+  gc_greypacket->mpk_items[gc_greypacket->mpk_len++] = itm;
+  if (YACA_UNLIKELY (gc_greypacket->mpk_len >= YACA_MARKPACKET_LEN))
+    {
+      gc_publish_packet (gc_greypacket);
+      gc_greypacket = NULL;
+    }
+}
+
+void
+yaca_gc_mark_item (struct yaca_item_st *itm)
+{
+  if (!itm || !__atomic_load_n (&yaca_gc_marking, __ATOMIC_ACQUIRE))
+    return;
+  assert (itm->itm_magic == YACA_ITEM_MAGIC);
+  if (yaca_item_shade (itm))
+    gc_push_grey (itm);
+}
+
+// scan a grey item, with its lock held if the workers are running;
+// return true if it was not yet black
+static bool
+gc_mark_scan (struct yaca_item_st *itm, bool locking)
+{
+  bool scanned = false;
+  struct yaca_itemtype_st *typ = yaca_typetab[itm->itm_typnum];
+  assert (typ && typ->typ_magic == YACA_TYPE_MAGIC);
+  if (locking)
+    yaca_item_lock (itm);
+  if (yaca_item_blacken (itm))
+    {
+      scanned = true;
+      if (typ->typr_gcscan)
+	(*typ->typr_gcscan) (itm);
+    }
+  if (locking)
+    yaca_item_unlock (itm);
+  return scanned;
+}
+
+// drain the grey packets, with the other markers
+static void
+gc_mark_drain (bool locking)
+{
+  struct yaca_markpacket_st *pk = NULL;
+  unsigned long nbscanned = 0;
+  yaca_items_read_begin ();
+  for (;;)
+    {
+      // scan our own grey items first, without locking
+      if (!pk || pk->mpk_len == 0)
 	{
-	  ad = yaca_allocate_in_region (yaca_common_smallreg, siz);
-	  if (YACA_UNLIKELY (ad == NULL))
+	  if (pk && gc_greypacket && gc_greypacket->mpk_len > 0)
 	    {
-	      struct yaca_region_st *newreg = yaca_new_smallregion ();
-	      newreg->reg_next = yaca_common_smallreg;
-	      yaca_common_smallreg = newreg;
-	      ad = yaca_allocate_in_region (yaca_common_smallreg, siz);
-	      yaca_should_garbage_collect ();
+	      struct yaca_markpacket_st *tmp = pk;
+	      pk = gc_greypacket;
+	      gc_greypacket = tmp;
 	    }
+	  else if (!pk && gc_greypacket && gc_greypacket->mpk_len > 0)
+	    {
+	      pk = gc_greypacket;
+	      gc_greypacket = NULL;
+	    }
+	}
+      if (pk && pk->mpk_len > 0)
+	{
+	  struct yaca_item_st *itm = pk->mpk_items[--pk->mpk_len];
+	  if (gc_mark_scan (itm, locking))
+	    nbscanned++;
+	  continue;
+	}
+      // take a packet from the other markers, or wait for one
+      pthread_mutex_lock (&gcmark.mutex);
+      if (pk)
+	{
+	  pk->mpk_next = gcmark.empty;
+	  gcmark.empty = pk;
+	  pk = NULL;
 	}
-      else if (siz < YACA_BIGREGION_SIZE / 2)
+      gcmark.nbidle++;
+      while (!gcmark.full && !gcmark.done)
 	{
-	  ad = yaca_allocate_in_region (yaca_common_bigreg, siz);
-	  if (YACA_UNLIKELY (ad == NULL))
+	  if (gcmark.nbidle >= gcmark.nbmarkers)
 	    {
-	      struct yaca_region_st *newreg = yaca_new_bigregion ();
-	      newreg->reg_next = yaca_common_bigreg;
-	      yaca_common_bigreg = newreg;
-	      ad = yaca_allocate_in_region (yaca_common_bigreg, siz);
-	      yaca_should_garbage_collect ();
+	      gcmark.done = true;
+	      pthread_cond_broadcast (&gcmark.cond);
+	      break;
 	    }
+	  pthread_cond_wait (&gcmark.cond, &gcmark.mutex);
 	}
-      pthread_mutex_unlock (&yaca_workalloc_mutex);
-      return ad;
+      if (gcmark.done)
+	{
+	  pthread_mutex_unlock (&gcmark.mutex);
+	  break;
+	}
+      gcmark.nbidle--;
+      pk = gcmark.full;
+      gcmark.full = pk->mpk_next;
+      pthread_mutex_unlock (&gcmark.mutex);
     }
+  yaca_items_read_end ();
+  __atomic_fetch_add (&gcstate.nbmarked, nbscanned, __ATOMIC_RELAXED);
+}
+
+// prepare a draining by some markers
+static void
+gc_mark_prepare (unsigned nbmarkers)
+{
+  pthread_mutex_lock (&gcmark.mutex);
+  gcmark.nbmarkers = nbmarkers;
+  gcmark.nbidle = 0;
+  gcmark.done = false;
+  pthread_mutex_unlock (&gcmark.mutex);
+}
+
+// mark the items which are roots
+static void
+gc_mark_roots (struct yaca_item_st **itmarr, unsigned nb)
+{
+  for (unsigned ix = 0; ix < nb; ix++)
+    if (itmarr[ix]->itm_spacnum != 0)
+      yaca_gc_mark_item (itmarr[ix]);
+}
+
+void
+yaca_gc_snapshot_item (struct yaca_item_st *itm)
+{
+  if (!itm)
+    return;
+  // the sweep waits for the snapshots in progress before starting
+  __atomic_add_fetch (&gcmark.nbsnapshots, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&yaca_gc_marking, __ATOMIC_SEQ_CST)
+      == YACA_GC_MARKING)
+    {
+      yaca_items_read_begin ();
+      gc_mark_scan (itm, true);
+      yaca_items_read_end ();
+      // threads without a final handshake should publish immediately
+      if (!yaca_this_worker || yaca_this_worker->worker_num <= 0)
+	{
+	  gc_publish_packet (gc_greypacket);
+	  gc_greypacket = NULL;
+	}
+    }
+  __atomic_sub_fetch (&gcmark.nbsnapshots, 1, __ATOMIC_SEQ_CST);
+}
+
+bool
+yaca_gc_keep_item (struct yaca_item_st *itm)
+{
+  bool alive = true;
+  // as for a snapshot, the sweep drains what we publish while marking
+  __atomic_add_fetch (&gcmark.nbsnapshots, 1, __ATOMIC_SEQ_CST);
+  int marking = __atomic_load_n (&yaca_gc_marking, __ATOMIC_SEQ_CST);
+  if (marking == YACA_GC_MARKING)
+    {
+      if (yaca_item_shade (itm))
+	{
+	  gc_push_grey (itm);
+	  gc_publish_packet (gc_greypacket);
+	  gc_greypacket = NULL;
+	}
+    }
+  else if (marking == YACA_GC_SWEEPING)
+    alive = yaca_item_is_marked (itm);
+  __atomic_sub_fetch (&gcmark.nbsnapshots, 1, __ATOMIC_SEQ_CST);
+  return alive;
+}
+
+// serially start marking, or remark after concurrent marking
+static void
+gc_mark_start (void)
+{
+  clock_gettime (CLOCK_MONOTONIC, &gcstate.startime);
+  gcstate.lastsafepoint =
+    (gcstate.startime.tv_sec - gcstate.stopreqtime.tv_sec)
+    + 1.0e-9 * (gcstate.startime.tv_nsec - gcstate.stopreqtime.tv_nsec);
+  gcstate.stopreqtime.tv_sec = gcstate.stopreqtime.tv_nsec = 0;
+  if (gcstate.concmarked)
+    {
+      // rescan every touched item which was reached
+      struct yaca_item_st **touched = NULL;
+      unsigned nbtouched = yaca_remembered_set_take (&touched);
+      for (unsigned ix = 0; ix < nbtouched; ix++)
+	{
+	  struct yaca_item_st *itm = touched[ix];
+	  // skip the items destroyed since they were touched
+	  if (yaca_item_of_id (itm->itm_id) != itm)
+	    continue;
+	  if (yaca_item_regrey (itm))
+	    gc_push_grey (itm);
+	}
+      free (touched);
+      gcstate.nbtouched = nbtouched;
+      // the tasks queued while marking
+      yaca_agenda_gcmark ();
+    }
+  else
+    {
+      yaca_items_clear_marks ();
+      gcstate.nbmarked = 0;
+      __atomic_store_n (&yaca_gc_marking, YACA_GC_MARKING, __ATOMIC_RELEASE);
+      yaca_agenda_gcmark ();
+    }
+  yaca_items_mark_pinned ();
+  gc_split_ids ();
+  gc_mark_prepare (yaca_nb_workers);
+}
+
+// serially end the marking and start sweeping
+static void
+gc_sweep_start (void)
+{
+  __atomic_store_n (&yaca_gc_marking, YACA_GC_SWEEPING, __ATOMIC_SEQ_CST);
+  gc_mark_prepare (yaca_nb_workers);
+  gcstate.nbswept = 0;
+  gc_split_ids ();
+}
+
+// destroy the items which were not reached; their ids are recycled
+// once the destroyed items are retired in gc_start
+static void
+gc_sweep_items (struct yaca_item_st **itmarr, unsigned nb)
+{
+  nb = yaca_items_sweep (itmarr, nb);
+  __atomic_fetch_add (&gcstate.nbswept, nb, __ATOMIC_RELAXED);
+}
+
+// move a chain of regions into the from space
+static void
+gc_gather_fromspace (struct yaca_region_st *reg)
+{
+  struct yaca_region_st *next = NULL;
+  for (; reg != NULL; reg = next)
+    {
+      next = reg->reg_next;
+      reg->reg_state |= YACA_REGSTATE_FROMSPACE;
+      reg->reg_next = gcstate.fromspace;
+      gcstate.fromspace = reg;
+      gcstate.nbfrom++;
+    }
+}
+
+// serially end the marking and start copying
+static void
+gc_start (void)
+{
+  __atomic_store_n (&yaca_gc_marking, 0, __ATOMIC_RELEASE);
+  gcstate.concmarked = false;
+  gcstate.fromspace = NULL;
+  gcstate.nbfrom = 0;
+  gcpacer.heapatstart = gc_heap_megabytes ();
+  for (unsigned wix = 1; wix <= yaca_nb_workers; wix++)
+    {
+      struct yaca_worker_st *tsk = yaca_worktab + wix;
+      gc_gather_fromspace (tsk->worker_region);
+      gc_gather_fromspace (tsk->worker_bigregion);
+      tsk->worker_region = tsk->worker_bigregion = NULL;
+    }
+  // the buffers of the other threads stay pinned, since their owners
+  // are not stopped, except the regions they handed at a safepoint
+  pthread_mutex_lock (&yaca_workalloc_mutex);
+  gc_gather_fromspace (yaca_released_regions);
+  yaca_released_regions = NULL;
+  pthread_mutex_unlock (&yaca_workalloc_mutex);
+  // large regions are not copied, only kept if they are reached
+  pthread_mutex_lock (&yaca_memory_mutex);
+  for (struct yaca_region_st * reg = yaca_large_regions; reg;
+       reg = reg->reg_next)
+    if (!(reg->reg_state & YACA_REGSTATE_PINNED))
+      reg->reg_state = YACA_REGSTATE_FROMSPACE;
+  pthread_mutex_unlock (&yaca_memory_mutex);
+  // the copying collector scans every item, so forget the touched ones
+  unsigned nbtouched = yaca_remembered_set_take (NULL);
+  // nothing refers anymore to the items destroyed before, once the
+  // stale deque slots are forgotten
+  yaca_agenda_gc_purge ();
+  yaca_items_retire_destroyed ();
+  if (nbtouched > 0)
+    gcstate.nbtouched = nbtouched;
+  gc_split_ids ();
+  gcstate.nextstripe = 0;
+  for (unsigned wix = 1; wix <= yaca_nb_workers; wix++)
+    {
+      gcstate.part[wix].gcp_smallto = gcstate.part[wix].gcp_bigto = NULL;
+      gcstate.part[wix].gcp_copied = 0;
+    }
+}
+
+// serially end a collection
+static void
+gc_finish (void)
+{
+  for (unsigned wix = 1; wix <= yaca_nb_workers; wix++)
+    {
+      struct yaca_gcpart_st *part = gcstate.part + wix;
+      yaca_worktab[wix].worker_region = part->gcp_smallto;
+      yaca_worktab[wix].worker_bigregion = part->gcp_bigto;
+      part->gcp_smallto = part->gcp_bigto = NULL;
+    }
+  // release the old regions
+  struct yaca_region_st *next = NULL;
+  for (struct yaca_region_st * reg = gcstate.fromspace; reg; reg = next)
+    {
+      next = reg->reg_next;
+      reg->reg_next = NULL;
+      yaca_delete_region (reg);
+    }
+  gcstate.fromspace = NULL;
+  // release the unreached large regions
+  struct yaca_region_st *deadlarge = NULL;
+  pthread_mutex_lock (&yaca_memory_mutex);
+  for (struct yaca_region_st ** preg = &yaca_large_regions; *preg;)
+    {
+      struct yaca_region_st *reg = *preg;
+      if (reg->reg_state == YACA_REGSTATE_FROMSPACE)
+	{
+	  *preg = reg->reg_next;
+	  reg->reg_next = deadlarge;
+	  deadlarge = reg;
+	}
+      else
+	{
+	  if (reg->reg_state & YACA_REGSTATE_FROMSPACE)
+	    reg->reg_state = 0;
+	  preg = &reg->reg_next;
+	}
+    }
+  pthread_mutex_unlock (&yaca_memory_mutex);
+  for (struct yaca_region_st * reg = deadlarge; reg; reg = next)
+    {
+      next = reg->reg_next;
+      yaca_delete_region (reg);
+    }
+  gc_open_gate ();
+  struct timespec endtime = { 0, 0 };
+  clock_gettime (CLOCK_MONOTONIC, &endtime);
+  gcstate.lastpause = (endtime.tv_sec - gcstate.startime.tv_sec)
+    + 1.0e-9 * (endtime.tv_nsec - gcstate.startime.tv_nsec);
+  gc_pacer_update (&endtime);
+  gcstate.nbcollections++;
+  struct yaca_gcrecord_st *rec =
+    gcrecords + gcstate.nbcollections % YACA_GC_NB_RECORDS;
+  struct timespec realtime = { 0, 0 };
+  clock_gettime (CLOCK_REALTIME, &realtime);
+  memset (rec, 0, sizeof (*rec));
+  rec->gcr_num = gcstate.nbcollections;
+  rec->gcr_endtime = realtime.tv_sec + 1.0e-9 * realtime.tv_nsec;
+  rec->gcr_pause = gcstate.lastpause;
+  rec->gcr_safepoint = gcstate.lastsafepoint;
+  for (unsigned wix = 1; wix <= yaca_nb_workers; wix++)
+    rec->gcr_copied += gcstate.part[wix].gcp_copied;
+  rec->gcr_freed = gcstate.nbfrom;
+  rec->gcr_live = gcstate.nbmarked;
+  rec->gcr_swept = gcstate.nbswept;
+  rec->gcr_heap = gc_heap_megabytes ();
+  gcstate.cyclerunning = false;
+}
+
+// allocate a chunk in the to-space of the current worker
+static struct yaca_chunk_st *
+gc_tospace_allocate (unsigned fullsiz)
+{
+  struct yaca_gcpart_st *part = gcstate.part + yaca_this_worker->worker_num;
+  bool big = fullsiz >= YACA_SMALLREGION_SIZE / 2;
+  struct yaca_region_st **preg = big ? &part->gcp_bigto : &part->gcp_smallto;
+  struct yaca_chunk_st *chk = yaca_allocate_in_region (*preg, fullsiz);
+  if (YACA_UNLIKELY (chk == NULL))
+    {
+      struct yaca_region_st *newreg =
+	big ? yaca_new_bigregion () : yaca_new_smallregion ();
+      newreg->reg_next = *preg;
+      *preg = newreg;
+      chk = yaca_allocate_in_region (newreg, fullsiz);
+    }
+  return chk;
 }
 
-// this is the work routine of the GC thread
+void *
+yaca_gc_forward (void *ptr)
+{
+  struct yaca_region_st *reg = yaca_find_region (ptr);
+  if (!reg || !(reg->reg_state & YACA_REGSTATE_FROMSPACE))
+    return ptr;
+  if (reg->reg_magic == YACA_LARGEREGION_MAGIC)
+    {
+      if (!(reg->reg_state & YACA_REGSTATE_LIVE))
+	__atomic_fetch_or (&reg->reg_state, YACA_REGSTATE_LIVE,
+			   __ATOMIC_RELAXED);
+      return ptr;
+    }
+  struct yaca_chunk_st *chk =
+    (struct yaca_chunk_st *) ((char *) ptr - sizeof (struct yaca_chunk_st));
+  assert (chk->chk_magic == YACA_CHUNK_MAGIC);
+  void *fwd = __atomic_load_n (&chk->chk_forward, __ATOMIC_ACQUIRE);
+  if (fwd)
+    return fwd;
+  // copy the chunk, but another worker may have copied it meanwhile
+  unsigned fullsiz = chk->chk_size;
+  struct yaca_chunk_st *newchk = gc_tospace_allocate (fullsiz);
+  memcpy (newchk, chk, fullsiz);
+  newchk->chk_forward = NULL;
+  if (__atomic_compare_exchange_n (&chk->chk_forward, &fwd,
+				   newchk->chk_data, false,
+				   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      gcstate.part[yaca_this_worker->worker_num].gcp_copied += fullsiz;
+      return newchk->chk_data;
+    }
+  // give back our copy, cleared since allocation expects zeros
+  struct yaca_region_st *toreg = yaca_find_region (newchk);
+  if ((char *) newchk + fullsiz == (char *) toreg->reg_free)
+    {
+      memset (newchk, 0, fullsiz);
+      toreg->reg_free = newchk;
+    }
+  return fwd;
+}
+
+void *
+yaca_gc_forwarded (void *ptr)
+{
+  struct yaca_region_st *reg = yaca_find_region (ptr);
+  if (!reg || !(reg->reg_state & YACA_REGSTATE_FROMSPACE))
+    return ptr;
+  if (reg->reg_magic == YACA_LARGEREGION_MAGIC)
+    return (reg->reg_state & YACA_REGSTATE_LIVE) ? ptr : NULL;
+  struct yaca_chunk_st *chk =
+    (struct yaca_chunk_st *) ((char *) ptr - sizeof (struct yaca_chunk_st));
+  assert (chk->chk_magic == YACA_CHUNK_MAGIC);
+  return __atomic_load_n (&chk->chk_forward, __ATOMIC_ACQUIRE);
+}
+
+// forward the region data of some items
+static void
+gc_evacuate_items (struct yaca_item_st **itmarr, unsigned nb)
+{
+  for (unsigned ix = 0; ix < nb; ix++)
+    {
+      struct yaca_itemtype_st *typ = yaca_typetab[itmarr[ix]->itm_typnum];
+      assert (typ && typ->typ_magic == YACA_TYPE_MAGIC);
+      if (typ->typr_gcscan)
+	(*typ->typr_gcscan) (itmarr[ix]);
+    }
+}
+
+void
+yaca_gc_start_concurrent_mark (void)
+{
+  pthread_mutex_lock (&gcstate.mutex);
+  if (!gcstate.cyclerunning)
+    {
+      gcstate.cyclerunning = true;
+      gcstate.markrequested = true;
+      pthread_cond_broadcast (&gcstate.cond);
+    }
+  pthread_mutex_unlock (&gcstate.mutex);
+}
+
+// mark concurrently in the GC thread, while the workers run
+static void
+gc_concurrent_mark (void)
+{
+  struct yaca_item_st *itembuf[YACA_GC_BLOCK];
+  yaca_items_read_begin ();
+  yaca_items_clear_marks ();
+  gcstate.nbmarked = 0;
+  __atomic_store_n (&yaca_gc_marking, YACA_GC_MARKING, __ATOMIC_RELEASE);
+  yaca_agenda_gcmark ();
+  yaca_id_t bound = yaca_items_bound ();
+  for (yaca_id_t lo = 1; lo < bound; lo += YACA_GC_BLOCK)
+    {
+      unsigned nb = yaca_items_in_range (lo, lo + YACA_GC_BLOCK, itembuf);
+      gc_mark_roots (itembuf, nb);
+    }
+  gc_mark_prepare (1);
+  gc_mark_drain (true);
+  yaca_items_read_end ();
+  pthread_mutex_lock (&gcstate.mutex);
+  gcstate.concmarked = true;
+  pthread_mutex_unlock (&gcstate.mutex);
+}
+
+// this is the work routine of the GC thread, which marks in
+// concurrent mode and reports the collections
 void *
 yaca_gcthread_work (void *d)
 {
@@ -538,9 +1687,60 @@ yaca_gcthread_work (void *d)
     YACA_FATAL ("invalid worker@%p", tsk);
   assert (tsk->worker_num == -(int) yacaworker_gc);
   yaca_this_worker = tsk;
+  {
+    pthread_t waiter;
+    if (sem_init (&gc_telemetry_sem, 0, 0))
+      YACA_FATAL ("failed to init telemetry semaphore - %m");
+    if (pthread_create (&waiter, NULL, gc_telemetry_waiter, NULL))
+      YACA_FATAL ("failed to create telemetry waiter thread");
+    pthread_detach (waiter);
+    struct sigaction usr1act;
+    memset (&usr1act, 0, sizeof (usr1act));
+    usr1act.sa_handler = gc_usr1_handler;
+    usr1act.sa_flags = SA_RESTART;
+    sigaction (SIGUSR1, &usr1act, NULL);
+  }
   sched_yield ();
-  yaca_wait_workers_all_at_state (yawrk_start_gc);
-#warning incomplete yaca_gcthread_work
+  unsigned long nbgc = 0;
+  for (;;)
+    {
+      yaca_work_safepoint ();
+      pthread_mutex_lock (&gcstate.mutex);
+      while (gcstate.nbcollections == nbgc && !gcstate.markrequested
+	     && !gc_telemetry_requested)
+	pthread_cond_wait (&gcstate.cond, &gcstate.mutex);
+      if (gc_telemetry_requested)
+	{
+	  gc_telemetry_requested = false;
+	  pthread_mutex_unlock (&gcstate.mutex);
+	  gc_dump_telemetry ();
+	  continue;
+	}
+      if (gcstate.markrequested)
+	{
+	  gcstate.markrequested = false;
+	  pthread_mutex_unlock (&gcstate.mutex);
+	  gc_concurrent_mark ();
+	  // the workers do the final remark and the copying
+	  gc_note_stop_request ();
+	  yaca_interrupt_agenda (yaint_gc);
+	  continue;
+	}
+      nbgc = gcstate.nbcollections;
+      double pause = gcstate.lastpause;
+      unsigned nbfrom = gcstate.nbfrom;
+      unsigned nbtouched = gcstate.nbtouched;
+      unsigned long nbmarked = gcstate.nbmarked;
+      unsigned long nbswept = gcstate.nbswept;
+      pthread_mutex_unlock (&gcstate.mutex);
+      YACA_SYSLOG (LOG_INFO,
+		   "garbage collection #%lu took %.3f ms, freed %u regions,"
+		   " %u touched items, %lu live items, %lu swept items,"
+		   " next at %ld Mb",
+		   nbgc, pause * 1.0e3, nbfrom, nbtouched, nbmarked, nbswept,
+		   yaca_gc_trigger_megabytes ());
+    }
+  return NULL;
 }
 
 // this is called by worker threads when GC is needed
@@ -548,10 +1748,42 @@ void
 yaca_worker_garbcoll (void)
 {
   assert (yaca_this_worker
-	  && yaca_this_worker->worker_magic == YACA_WORKER_MAGIC);
+	  && yaca_this_worker->worker_magic == YACA_WORKER_MAGIC
+	  && yaca_this_worker->worker_num > 0);
+  gc_note_stop_request ();
+  // the items destroyed since the previous collection stay readable
+  // till the tuples mentioning them are forgotten
+  yaca_items_pin ();
+  // give our snapshotted grey items to the markers
+  gc_publish_packet (gc_greypacket);
+  gc_greypacket = NULL;
   // wait till all worker's state is start_gc
   yaca_wait_workers_all_at_state (yawrk_start_gc);
-#warning yaca_worker_garbcoll incomplete
+  gc_barrier (gc_mark_start);
+  if (!gcstate.concmarked)
+    gc_parallel_items (yaca_items_in_range, gc_mark_roots);
+  gc_mark_drain (false);
+  gc_barrier (gc_sweep_start);
+  // the other threads may have snapshotted items after the markers
+  // were done, so drain their grey items too, without the GC mutex
+  // since they may hold the item locks
+  while (__atomic_load_n (&gcmark.nbsnapshots, __ATOMIC_SEQ_CST) > 0)
+    sched_yield ();
+  gc_mark_drain (true);
+  // the mark bitmaps skip quickly the blocks of live items
+  gc_parallel_items (yaca_items_unmarked_in_range, gc_sweep_items);
+  gc_close_gate ();
+  gc_barrier (gc_start);
+  gc_parallel_items (yaca_items_in_range, gc_evacuate_items);
+  // once every tuple is forwarded, the weak hash-consed tuples are
+  // updated, stripe by stripe, before their regions are released
+  gc_barrier (NULL);
+  for (unsigned st;
+       (st = __atomic_fetch_add (&gcstate.nextstripe, 1, __ATOMIC_RELAXED))
+       < YACA_TUPLE_STRIPES;)
+    yaca_tuples_gc_fixup (st);
+  gc_barrier (gc_finish);
+  yaca_items_unpin ();
 }
 
 // eof garbcoll.c
@@ -45,6 +45,11 @@ static struct option yaca_options[] = {
   {"sourcedir", required_argument, NULL, 's'},
   {"objectdir", required_argument, NULL, 'o'},
   {"nice", required_argument, NULL, 'n'},
+  {"poolhigh", required_argument, NULL, 'H'},
+  {"poollow", required_argument, NULL, 'L'},
+  {"gcmode", required_argument, NULL, 'G'},
+  {"gcgrowth", required_argument, NULL, 'g'},
+  {"heapcap", required_argument, NULL, 'C'},
   {NULL, no_argument, NULL, 0}
 };
 
@@ -56,24 +61,521 @@ static const char *pid_file_path;
 static int nice_level;
 static bool should_daemonize;
 
+/** The table of items is read without lock. It is replaced by a
+   bigger copy when growing, under the items mutex, and the old copy is
+   freed only when every reader which could have seen it has left, as
+   told by the reader epochs below. The same table keeps word-packed
+   bitmaps of the used or reserved ids, and of the marks of items: a
+   white item has no mark bit, a grey one has its reached bit, a black
+   one also has its scanned bit. Mark bits are updated atomically, so
+   several threads can mark in parallel.
+
+   Each thread makes its items with ids reserved by blocks, so it
+   stores them in the table without lock. It takes them out of its
+   block atomically, since yaca_item_build may take a reserved id out
+   of the block of another thread; the ids left in the block of an
+   exited thread are freed. To grow the table, the
+   items mutex is taken and the old table is frozen before being
+   copied; a maker or a marker which finds the table frozen after
+   updating it does its update again, under the mutex, in the new
+   table.
+
+   A destroyed item is removed from the table at once, but kept in the
+   dying items until the next garbage collection starts, since the
+   remembered set or the mark packets could still refer to it. It is
+   then retired like an old table, and its memory and its id are
+   reclaimed once no pinned thread can see it.
+**/
+struct yaca_itemtable_st
+{
+  yaca_id_t itab_size;		/* a multiple of 64 */
+  int itab_frozen;		/* set when being copied */
+  uint64_t *itab_used;		/* bitmap of used or reserved ids */
+  uint64_t *itab_reached;	/* bitmap of grey or black items */
+  uint64_t *itab_scanned;	/* bitmap of black items */
+  struct yaca_item_st *itab_arr[];	/* itab_size entries, followed by
+					   the bitmaps */
+};
+
+struct yaca_deaditems_st
+{
+  unsigned dit_len;
+  unsigned dit_size;
+  struct yaca_item_st *dit_arr[];	/* dit_size entries */
+};
+
+#define YACA_IDBLOCK_LEN 64	/* ids reserved at once by a thread */
+struct yaca_idblock_st
+{
+  uint64_t idb_avail;		/* bits of the ids not yet taken,
+				   atomically cleared */
+  yaca_id_t idb_ids[YACA_IDBLOCK_LEN];	/* refilled under the items mutex */
+  struct yaca_idblock_st *idb_next;
+};
+static __thread struct yaca_idblock_st *yaca_this_idblock;
+
 static struct
 {
   pthread_mutex_t mutex;
   yaca_id_t sizarr;
-  yaca_id_t count;
-  struct yaca_item_st **itemarr;	/* array of sizarr entries */
-  unsigned char *markarr;	/* array of sizarr entries */
+  yaca_id_t count;		/* atomically incremented */
+  struct yaca_itemtable_st *table;	/* of sizarr entries, published
+					   atomically */
+  yaca_id_t nbtaken;		/* number of used or reserved ids */
+  struct yaca_deaditems_st *dying;	/* destroyed since the last GC */
   struct drand48_data r48data;
-  pthread_mutexattr_t mutexattr;
+  struct yaca_idblock_st *idblocks;	/* of the living threads */
+  pthread_key_t idblockkey;
 } yaca_items =
 {
-  PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL, NULL,
-  {
-  },
+  PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL, 0, NULL,
   {
   }
 };
 
+/** Each reading thread has an epoch slot, holding the global epoch
+   seen when it started reading, or 0 outside of reads. Reads may be
+   nested, only the outermost one sets the epoch. Replaced tables and
+   destroyed items are retired with the epoch of their replacement,
+   and freed once no slot holds an older, non-zero, epoch.
+**/
+struct yaca_epochslot_st
+{
+  unsigned long eps_epoch;	/* atomically updated */
+  unsigned eps_depth;		/* nesting of reads, by the owner */
+  unsigned eps_pindepth;	/* nesting of pins, for non-workers */
+  pthread_mutex_t eps_pinmutex;	/* for the recorded items */
+  unsigned eps_nbpinned;
+  unsigned eps_sizpinned;
+  struct yaca_item_st **eps_pinned;	/* made or found by id while pinned */
+  bool eps_used;		/* owned by a live thread */
+  struct yaca_epochslot_st *eps_next;
+} __attribute__ ((aligned (64)));
+
+struct yaca_retired_st
+{
+  void *ret_ptr;
+  void (*ret_free) (void *);
+  unsigned long ret_epoch;
+  struct yaca_retired_st *ret_next;
+};
+
+static struct
+{
+  pthread_mutex_t mutex;	/* for the slots and the retired list */
+  unsigned long epoch;		/* atomically incremented, never 0 */
+  struct yaca_epochslot_st *slots;
+  struct yaca_retired_st *retired;
+  pthread_key_t key;
+} yaca_epochs =
+{
+PTHREAD_MUTEX_INITIALIZER, 1, NULL, NULL};
+
+static __thread struct yaca_epochslot_st *yaca_this_epochslot;
+
+// at thread exit, make its slot reusable
+static void
+epoch_release_slot (void *d)
+{
+  struct yaca_epochslot_st *slot = d;
+  slot->eps_depth = 0;
+  if (slot->eps_pindepth > 0)
+    {
+      slot->eps_pindepth = 0;
+      pthread_mutex_lock (&slot->eps_pinmutex);
+      slot->eps_nbpinned = 0;
+      pthread_mutex_unlock (&slot->eps_pinmutex);
+      yaca_gc_leave_pinned ();
+    }
+  __atomic_store_n (&slot->eps_epoch, 0, __ATOMIC_RELEASE);
+  pthread_mutex_lock (&yaca_epochs.mutex);
+  slot->eps_used = false;
+  pthread_mutex_unlock (&yaca_epochs.mutex);
+}
+
+static struct yaca_epochslot_st *
+epoch_this_slot (void)
+{
+  struct yaca_epochslot_st *slot = yaca_this_epochslot;
+  if (YACA_LIKELY (slot != NULL))
+    return slot;
+  pthread_mutex_lock (&yaca_epochs.mutex);
+  for (slot = yaca_epochs.slots; slot && slot->eps_used;
+       slot = slot->eps_next);
+  if (!slot)
+    {
+      if (posix_memalign ((void **) &slot, 64, sizeof (*slot)))
+	YACA_FATAL ("failed to allocate epoch slot");
+      memset (slot, 0, sizeof (*slot));
+      pthread_mutex_init (&slot->eps_pinmutex, NULL);
+      slot->eps_next = yaca_epochs.slots;
+      yaca_epochs.slots = slot;
+    }
+  slot->eps_used = true;
+  pthread_mutex_unlock (&yaca_epochs.mutex);
+  pthread_setspecific (yaca_epochs.key, slot);
+  yaca_this_epochslot = slot;
+  return slot;
+}
+
+// start reading the item table
+static inline struct yaca_itemtable_st *
+items_read_begin (void)
+{
+  struct yaca_epochslot_st *slot = epoch_this_slot ();
+  if (slot->eps_depth++ == 0)
+    {
+      __atomic_store_n (&slot->eps_epoch,
+			__atomic_load_n (&yaca_epochs.epoch,
+					 __ATOMIC_SEQ_CST), __ATOMIC_RELAXED);
+      // the table should be loaded after our epoch is visible
+      __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    }
+  return __atomic_load_n (&yaca_items.table, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+items_read_end (void)
+{
+  struct yaca_epochslot_st *slot = yaca_this_epochslot;
+  assert (slot && slot->eps_depth > 0);
+  if (--slot->eps_depth == 0)
+    __atomic_store_n (&slot->eps_epoch, 0, __ATOMIC_RELEASE);
+}
+
+void
+yaca_items_read_begin (void)
+{
+  (void) items_read_begin ();
+}
+
+void
+yaca_items_read_end (void)
+{
+  items_read_end ();
+}
+
+// true in the threads other than the workers
+static inline bool
+items_nonworker (void)
+{
+  struct yaca_worker_st *wrk = yaca_this_worker;
+  return !wrk || wrk->worker_num <= 0;
+}
+
+void
+yaca_items_pin (void)
+{
+  if (YACA_UNLIKELY (items_nonworker ()))
+    {
+      // the GC does not copy while such threads are pinned
+      struct yaca_epochslot_st *slot = epoch_this_slot ();
+      if (slot->eps_pindepth++ == 0)
+	yaca_gc_enter_pinned ();
+    }
+  (void) items_read_begin ();
+}
+
+void
+yaca_items_unpin (void)
+{
+  items_read_end ();
+  if (YACA_UNLIKELY (items_nonworker ()))
+    {
+      struct yaca_epochslot_st *slot = yaca_this_epochslot;
+      assert (slot && slot->eps_pindepth > 0);
+      if (--slot->eps_pindepth == 0)
+	{
+	  // its recorded items are no longer roots
+	  pthread_mutex_lock (&slot->eps_pinmutex);
+	  slot->eps_nbpinned = 0;
+	  pthread_mutex_unlock (&slot->eps_pinmutex);
+	  yaca_gc_leave_pinned ();
+	}
+    }
+}
+
+/* A pinned thread other than the workers records the items it makes or
+   finds by id, and the GC marks them as roots till it unpins. An item
+   is recorded before its marks are set when made, so either the GC
+   sees it in the record, or the item sees the GC marking and is made
+   black. */
+static void
+items_record_pinned (struct yaca_item_st *itm)
+{
+  struct yaca_epochslot_st *slot = yaca_this_epochslot;
+  if (YACA_LIKELY (!slot || slot->eps_pindepth == 0))
+    return;
+  pthread_mutex_lock (&slot->eps_pinmutex);
+  unsigned nb = slot->eps_nbpinned;
+  // an item is often found again just after
+  for (unsigned ix = nb; ix > 0 && ix + 4 > nb; ix--)
+    if (slot->eps_pinned[ix - 1] == itm)
+      goto end;
+  if (YACA_UNLIKELY (nb >= slot->eps_sizpinned))
+    {
+      unsigned newsiz = 2 * nb + 30;
+      struct yaca_item_st **newarr =
+	realloc (slot->eps_pinned, newsiz * sizeof (struct yaca_item_st *));
+      if (!newarr)
+	YACA_FATAL ("failed to grow pinned items to %u", newsiz);
+      slot->eps_pinned = newarr;
+      slot->eps_sizpinned = newsiz;
+    }
+  slot->eps_pinned[slot->eps_nbpinned++] = itm;
+  goto end;
+end:
+  pthread_mutex_unlock (&slot->eps_pinmutex);
+}
+
+void
+yaca_items_mark_pinned (void)
+{
+  pthread_mutex_lock (&yaca_epochs.mutex);
+  for (struct yaca_epochslot_st * slot = yaca_epochs.slots; slot;
+       slot = slot->eps_next)
+    {
+      pthread_mutex_lock (&slot->eps_pinmutex);
+      for (unsigned ix = 0; ix < slot->eps_nbpinned; ix++)
+	{
+	  struct yaca_item_st *itm = slot->eps_pinned[ix];
+	  // skip the items destroyed since they were recorded
+	  if (!(__atomic_load_n (&itm->itm_flags, __ATOMIC_ACQUIRE)
+		& YACA_ITEMFLAG_DESTROYED))
+	    yaca_gc_mark_item (itm);
+	}
+      pthread_mutex_unlock (&slot->eps_pinmutex);
+    }
+  pthread_mutex_unlock (&yaca_epochs.mutex);
+}
+
+// free the retired pointers that no reader can see anymore; should be
+// called without the items mutex, which is needed to reclaim items
+static void
+epoch_reclaim (void)
+{
+  struct yaca_retired_st *expired = NULL;
+  if (!__atomic_load_n (&yaca_epochs.retired, __ATOMIC_RELAXED))
+    return;
+  pthread_mutex_lock (&yaca_epochs.mutex);
+  unsigned long oldest = ULONG_MAX;
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  for (struct yaca_epochslot_st * slot = yaca_epochs.slots; slot;
+       slot = slot->eps_next)
+    {
+      unsigned long ep = __atomic_load_n (&slot->eps_epoch, __ATOMIC_ACQUIRE);
+      if (ep != 0 && ep < oldest)
+	oldest = ep;
+    }
+  for (struct yaca_retired_st ** pret = &yaca_epochs.retired; *pret;)
+    {
+      struct yaca_retired_st *ret = *pret;
+      if (ret->ret_epoch < oldest)
+	{
+	  *pret = ret->ret_next;
+	  ret->ret_next = expired;
+	  expired = ret;
+	}
+      else
+	pret = &ret->ret_next;
+    }
+  pthread_mutex_unlock (&yaca_epochs.mutex);
+  while (expired)
+    {
+      struct yaca_retired_st *ret = expired;
+      expired = ret->ret_next;
+      (*ret->ret_free) (ret->ret_ptr);
+      free (ret);
+    }
+}
+
+// retire a pointer which was just unpublished, to be freed by freefun
+// in a later epoch_reclaim
+static void
+epoch_retire (void *ptr, void (*freefun) (void *))
+{
+  struct yaca_retired_st *ret = malloc (sizeof (*ret));
+  if (!ret)
+    YACA_FATAL ("failed to retire %p", ptr);
+  ret->ret_ptr = ptr;
+  ret->ret_free = freefun;
+  // readers starting from now get the new epoch, and cannot see ptr
+  ret->ret_epoch = __atomic_fetch_add (&yaca_epochs.epoch, 1,
+				       __ATOMIC_SEQ_CST);
+  pthread_mutex_lock (&yaca_epochs.mutex);
+  ret->ret_next = yaca_epochs.retired;
+  yaca_epochs.retired = ret;
+  pthread_mutex_unlock (&yaca_epochs.mutex);
+}
+
+// grow the item table and its bitmaps, under the items mutex; the
+// size should be a multiple of 64
+static void
+items_grow (yaca_id_t newsiz)
+{
+  struct yaca_itemtable_st *oldtab = yaca_items.table;
+  yaca_id_t oldsiz = yaca_items.sizarr;
+  assert (newsiz % 64 == 0 && newsiz > oldsiz);
+  struct yaca_itemtable_st *newtab =
+    calloc (1, sizeof (struct yaca_itemtable_st)
+	    + newsiz * sizeof (struct yaca_item_st *)
+	    + 3 * (newsiz / 64) * sizeof (uint64_t));
+  if (!newtab)
+    YACA_FATAL ("failed to grow item array to %ld", (long) newsiz);
+  newtab->itab_size = newsiz;
+  newtab->itab_used = (uint64_t *) (newtab->itab_arr + newsiz);
+  newtab->itab_reached = newtab->itab_used + newsiz / 64;
+  newtab->itab_scanned = newtab->itab_reached + newsiz / 64;
+  if (oldtab)
+    {
+      // makers and markers updating from now will update again the
+      // new table
+      __atomic_store_n (&oldtab->itab_frozen, 1, __ATOMIC_SEQ_CST);
+      for (yaca_id_t id = 0; id < oldsiz; id++)
+	newtab->itab_arr[id] =
+	  __atomic_load_n (oldtab->itab_arr + id, __ATOMIC_SEQ_CST);
+      for (yaca_id_t w = 0; w < oldsiz / 64; w++)
+	{
+	  newtab->itab_used[w] = oldtab->itab_used[w];
+	  newtab->itab_reached[w] =
+	    __atomic_load_n (oldtab->itab_reached + w, __ATOMIC_SEQ_CST);
+	  newtab->itab_scanned[w] =
+	    __atomic_load_n (oldtab->itab_scanned + w, __ATOMIC_SEQ_CST);
+	}
+    }
+  else
+    {
+      // the id 0 is never used
+      newtab->itab_used[0] = 1;
+      yaca_items.nbtaken = 1;
+    }
+  yaca_items.sizarr = newsiz;
+  __atomic_store_n (&yaca_items.table, newtab, __ATOMIC_SEQ_CST);
+  if (oldtab)
+    epoch_retire (oldtab, free);
+}
+
+// reserve a block of free ids for the current thread, starting from a
+// random word of the used bitmap, under the items mutex
+static void
+items_reserve_idblock (void)
+{
+  struct yaca_idblock_st *blk = yaca_this_idblock;
+  if (!blk)
+    {
+      blk = calloc (1, sizeof (struct yaca_idblock_st));
+      if (!blk)
+	YACA_FATAL ("failed to allocate id block");
+      blk->idb_next = yaca_items.idblocks;
+      yaca_items.idblocks = blk;
+      pthread_setspecific (yaca_items.idblockkey, blk);
+      yaca_this_idblock = blk;
+    }
+  if (YACA_UNLIKELY (3 * (yaca_items.nbtaken + YACA_IDBLOCK_LEN) + 50
+		     > 2 * yaca_items.sizarr))
+    // double the table, so the copies stay amortized
+    items_grow (((3 * yaca_items.nbtaken + 3 * YACA_IDBLOCK_LEN + 300)
+		 | 0x1ff) + 1);
+  uint64_t *used = yaca_items.table->itab_used;
+  yaca_id_t nbwords = yaca_items.sizarr / 64;
+  long rnd = 0;
+  lrand48_r (&yaca_items.r48data, &rnd);
+  unsigned len = 0;
+  for (yaca_id_t w = rnd % nbwords; len < YACA_IDBLOCK_LEN;
+       w = (w + 1) % nbwords)
+    {
+      uint64_t freebits = ~used[w];
+      while (freebits && len < YACA_IDBLOCK_LEN)
+	{
+	  unsigned bit = __builtin_ctzll (freebits);
+	  freebits &= freebits - 1;
+	  __atomic_fetch_or (used + w, (uint64_t) 1 << bit,
+			     __ATOMIC_RELAXED);
+	  blk->idb_ids[len++] = w * 64 + bit;
+	}
+    }
+  yaca_items.nbtaken += len;
+  __atomic_store_n (&blk->idb_avail, (len < 64) ? (((uint64_t) 1 << len) - 1)
+		    : ~(uint64_t) 0, __ATOMIC_RELEASE);
+}
+
+// take the next id of the block of the current thread, refilling it
+// when empty
+static yaca_id_t
+items_take_id (void)
+{
+  struct yaca_idblock_st *blk = yaca_this_idblock;
+  for (;;)
+    {
+      uint64_t avail =
+	blk ? __atomic_load_n (&blk->idb_avail, __ATOMIC_ACQUIRE) : 0;
+      while (avail)
+	{
+	  unsigned k = __builtin_ctzll (avail);
+	  uint64_t bit = (uint64_t) 1 << k;
+	  // yaca_item_build may have taken it meanwhile
+	  avail = __atomic_fetch_and (&blk->idb_avail, ~bit, __ATOMIC_ACQ_REL);
+	  if (YACA_LIKELY (avail & bit))
+	    return blk->idb_ids[k];
+	}
+      pthread_mutex_lock (&yaca_items.mutex);
+      items_reserve_idblock ();
+      pthread_mutex_unlock (&yaca_items.mutex);
+      epoch_reclaim ();
+      blk = yaca_this_idblock;
+    }
+}
+
+// take an id reserved, but not yet taken, out of the block of some
+// thread, under the items mutex; return false if it was really taken
+static bool
+items_unreserve_id (yaca_id_t id)
+{
+  for (struct yaca_idblock_st * blk = yaca_items.idblocks; blk;
+       blk = blk->idb_next)
+    for (uint64_t avail = __atomic_load_n (&blk->idb_avail, __ATOMIC_ACQUIRE);
+	 avail != 0; avail &= avail - 1)
+      {
+	unsigned k = __builtin_ctzll (avail);
+	if (blk->idb_ids[k] != id)
+	  continue;
+	uint64_t bit = (uint64_t) 1 << k;
+	return (__atomic_fetch_and (&blk->idb_avail, ~bit, __ATOMIC_ACQ_REL)
+		& bit) != 0;
+      }
+  return false;
+}
+
+// at thread exit, free the ids left in its block
+static void
+items_release_idblock (void *d)
+{
+  struct yaca_idblock_st *blk = d;
+  pthread_mutex_lock (&yaca_items.mutex);
+  // the table cannot be copied while we hold the mutex
+  uint64_t *used = yaca_items.table->itab_used;
+  for (uint64_t avail = __atomic_exchange_n (&blk->idb_avail, 0,
+					     __ATOMIC_ACQ_REL);
+       avail != 0; avail &= avail - 1)
+    {
+      yaca_id_t id = blk->idb_ids[__builtin_ctzll (avail)];
+      __atomic_fetch_and (used + id / 64, ~((uint64_t) 1 << (id % 64)),
+			  __ATOMIC_RELAXED);
+      yaca_items.nbtaken--;
+    }
+  for (struct yaca_idblock_st ** pblk = &yaca_items.idblocks; *pblk;
+       pblk = &(*pblk)->idb_next)
+    if (*pblk == blk)
+      {
+	*pblk = blk->idb_next;
+	break;
+      }
+  pthread_mutex_unlock (&yaca_items.mutex);
+  if (yaca_this_idblock == blk)
+    yaca_this_idblock = NULL;
+  free (blk);
+}
+
 static void
 print_usage (void)
 {
@@ -88,6 +590,16 @@ print_usage (void)
   printf ("\t -d | --datadir <directory> " " \t# data directory.\n");
   printf ("\t -o | --objectdir <directory> " " \t# object directory.\n");
   printf ("\t -n | --nice <nice_level> " " \t# process nice priority.\n");
+  printf ("\t -H | --poolhigh <megabytes> "
+	  " \t# high watermark of retired region pool.\n");
+  printf ("\t -L | --poollow <megabytes> "
+	  " \t# low watermark of retired region pool.\n");
+  printf ("\t -G | --gcmode stoptheworld|concurrent "
+	  " \t# garbage collector marking mode.\n");
+  printf ("\t -g | --gcgrowth <factor> "
+	  " \t# heap growth between garbage collections.\n");
+  printf ("\t -C | --heapcap <megabytes> "
+	  " \t# maximal heap size, or 0 for none.\n");
   printf ("\t built on %s\n", yaca_build_timestamp);
 }
 
@@ -105,7 +617,7 @@ parse_program_arguments (int argc, char **argv)
 {
   int opt = -1;
   while ((opt =
-	  getopt_long (argc, argv, "hDw:u:p:d:s:o:n:", yaca_options,
+	  getopt_long (argc, argv, "hDw:u:p:d:s:o:n:H:L:G:g:C:", yaca_options,
 		       NULL)) >= 0)
     {
       switch (opt)
@@ -139,6 +651,35 @@ parse_program_arguments (int argc, char **argv)
 	case 'n':
 	  if (optarg)
 	    nice_level = atoi (optarg);
+	  break;
+	case 'H':
+	  if (optarg)
+	    yaca_regpool_high_megabytes = atol (optarg);
+	  break;
+	case 'L':
+	  if (optarg)
+	    yaca_regpool_low_megabytes = atol (optarg);
+	  break;
+	case 'G':
+	  if (optarg && !strcmp (optarg, "concurrent"))
+	    yaca_gc_mode = yagc_concurrent;
+	  else if (optarg && !strcmp (optarg, "stoptheworld"))
+	    yaca_gc_mode = yagc_stoptheworld;
+	  else
+	    {
+	      fprintf (stderr, "%s: bad GC mode %s\n", yaca_progname,
+		       optarg);
+	      exit (EXIT_FAILURE);
+	    }
+	  break;
+	case 'g':
+	  if (optarg)
+	    yaca_gc_growth_factor = atof (optarg);
+	  break;
+	case 'C':
+	  if (optarg)
+	    yaca_gc_heapcap_megabytes = atol (optarg);
+	  break;
 	default:
 	  print_usage ();
 	  fprintf (stderr, "%s: unexpected argument\n", yaca_progname);
@@ -165,15 +706,15 @@ initialize_random (void)
 static void
 initialize_items (void)
 {
-  pthread_mutexattr_init (&yaca_items.mutexattr);
-  pthread_mutexattr_settype (&yaca_items.mutexattr,
-			     PTHREAD_MUTEX_RECURSIVE_NP);
+  if (pthread_key_create (&yaca_epochs.key, epoch_release_slot))
+    YACA_FATAL ("cannot create the epoch key");
+  if (pthread_key_create (&yaca_items.idblockkey, items_release_idblock))
+    YACA_FATAL ("cannot create the id block key");
   unsigned inisiz = 1024;
-  yaca_items.itemarr = calloc (inisiz, sizeof (struct yaca_item_st *));
-  yaca_items.markarr = calloc (inisiz, sizeof (char));
-  yaca_items.sizarr = inisiz;
-  if (!yaca_items.itemarr || !yaca_items.markarr)
-    YACA_FATAL ("cannot initialize items of %d", inisiz);
+  pthread_mutex_lock (&yaca_items.mutex);
+  yaca_items.sizarr = 0;
+  items_grow (inisiz);
+  pthread_mutex_unlock (&yaca_items.mutex);
 }
 
 
@@ -209,6 +750,426 @@ yaca_drand48 (void)
   return d;
 }
 
+/** Items are allocated in slabs of a given size class. Each thread
+   has a magazine with its current slabs, so it allocates items without
+   any lock, and takes the slabs mutex only to get a new slab. A
+   magazine has a few lanes per size class, chosen by the type and
+   space of the item, so items of the same type and space tend to be
+   neighbours. Slabs are carved from arenas, which are never unmapped,
+   and start with a small header. Items too big for any size class are
+   calloc-ed. The magazine of an exiting thread is lost, with the rest
+   of its current slabs. Reclaimed items are chained by size class,
+   and a magazine takes the whole chain of a class before using a
+   fresh slab.
+**/
+#define YACA_ITEMSLAB_MAGIC 1360471429	/*0x51172585 */
+#define YACA_ITEMSLAB_SIZE (64*1024)
+#define YACA_ITEMARENA_SIZE (4*1024*1024)
+#define YACA_ITEMSLAB_MAXSIZE (16*1024)
+#define YACA_ITEMSLAB_NBCLASSES 35
+#define YACA_ITEMSLAB_LANES 4
+struct yaca_itemslab_st
+{
+  uint32_t isl_magic;		/* always YACA_ITEMSLAB_MAGIC */
+  uint16_t isl_class;		/* the size class of its items */
+  uint16_t isl_lane;
+  long long isl_items[] __attribute__ ((aligned (YACA_MINALIGNMENT)));
+};
+
+struct yaca_itemmag_st
+{
+  char *imag_free[YACA_ITEMSLAB_NBCLASSES][YACA_ITEMSLAB_LANES];
+  char *imag_end[YACA_ITEMSLAB_NBCLASSES][YACA_ITEMSLAB_LANES];
+  char *imag_recycled[YACA_ITEMSLAB_NBCLASSES];	/* chained reclaimed items */
+};
+static __thread struct yaca_itemmag_st *yaca_this_itemmag;
+
+static struct
+{
+  pthread_mutex_t mutex;
+  char *arenafree;		/* next slab in the current arena */
+  char *arenaend;
+  unsigned long nbslabs;
+  char *reclaimed[YACA_ITEMSLAB_NBCLASSES];	/* chained by their first word */
+} yaca_itemslabs =
+{
+  PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0,
+  {
+  }
+};
+
+// the size class of a small enough item size: steps of 32 bytes up
+// to 512, then four classes between powers of two
+static inline unsigned
+item_size_class (size_t sz)
+{
+  if (sz <= 64)
+    return 0;
+  if (sz <= 512)
+    return (sz + 31) / 32 - 2;
+  unsigned lg = 8 * sizeof (long) - 1 - __builtin_clzl (sz - 1);
+  size_t quarter = (size_t) 1 << (lg - 2);
+  return 15 + (lg - 9) * 4 + (sz - 1 - ((size_t) 1 << lg)) / quarter;
+}
+
+static inline size_t
+item_class_size (unsigned cl)
+{
+  if (cl < 15)
+    return (cl + 2) * 32;
+  unsigned lg = 9 + (cl - 15) / 4;
+  return ((size_t) 1 << lg) + ((cl - 15) % 4 + 1) * ((size_t) 1 << (lg - 2));
+}
+
+// get a fresh slab from the current arena, mapping a new one if needed
+static struct yaca_itemslab_st *
+item_new_slab (unsigned cl, unsigned lane)
+{
+  struct yaca_itemslab_st *slab = NULL;
+  pthread_mutex_lock (&yaca_itemslabs.mutex);
+  if (!yaca_itemslabs.arenafree
+      || yaca_itemslabs.arenafree + YACA_ITEMSLAB_SIZE >
+      yaca_itemslabs.arenaend)
+    {
+      char *ad = mmap (NULL, YACA_ITEMARENA_SIZE,
+		       PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		       -1,
+		       (off_t) 0);
+      if (ad == MAP_FAILED)
+	YACA_FATAL ("failed to mmap item arena - %m");
+      // slabs are aligned, to find the slab of an item
+      yaca_itemslabs.arenafree =
+	(char *) ((((uintptr_t) ad - 1) | (YACA_ITEMSLAB_SIZE - 1)) + 1);
+      yaca_itemslabs.arenaend = ad + YACA_ITEMARENA_SIZE;
+    }
+  slab = (struct yaca_itemslab_st *) yaca_itemslabs.arenafree;
+  yaca_itemslabs.arenafree += YACA_ITEMSLAB_SIZE;
+  yaca_itemslabs.nbslabs++;
+  slab->isl_magic = YACA_ITEMSLAB_MAGIC;
+  slab->isl_class = cl;
+  slab->isl_lane = lane;
+  goto end;
+end:
+  pthread_mutex_unlock (&yaca_itemslabs.mutex);
+  return slab;
+}
+
+// allocate the zeroed memory of an item, and note its size and flags
+static struct yaca_item_st *
+item_allocate (size_t sz, yaca_typenum_t typnum, yaca_spacenum_t spacenum)
+{
+  struct yaca_item_st *itm = NULL;
+  if (YACA_UNLIKELY (sz > YACA_ITEMSLAB_MAXSIZE))
+    {
+      itm = calloc (1, sz);
+      if (!itm)
+	YACA_FATAL ("failed to allocate item of %d bytes", (int) sz);
+      goto end;
+    }
+  struct yaca_itemmag_st *mag = yaca_this_itemmag;
+  if (YACA_UNLIKELY (!mag))
+    {
+      mag = calloc (1, sizeof (struct yaca_itemmag_st));
+      if (!mag)
+	YACA_FATAL ("failed to allocate item magazine - %m");
+      yaca_this_itemmag = mag;
+    }
+  unsigned cl = item_size_class (sz);
+  unsigned lane = ((unsigned) typnum * 17 + spacenum) % YACA_ITEMSLAB_LANES;
+  size_t clsz = item_class_size (cl);
+  char *ad = mag->imag_free[cl][lane];
+  if (YACA_UNLIKELY (!ad || ad + clsz > mag->imag_end[cl][lane]))
+    {
+      if (!mag->imag_recycled[cl]
+	  && __atomic_load_n (yaca_itemslabs.reclaimed + cl,
+			      __ATOMIC_RELAXED))
+	{
+	  pthread_mutex_lock (&yaca_itemslabs.mutex);
+	  mag->imag_recycled[cl] = yaca_itemslabs.reclaimed[cl];
+	  yaca_itemslabs.reclaimed[cl] = NULL;
+	  pthread_mutex_unlock (&yaca_itemslabs.mutex);
+	}
+      char *rad = mag->imag_recycled[cl];
+      if (rad)
+	{
+	  mag->imag_recycled[cl] = *(char **) rad;
+	  memset (rad, 0, clsz);
+	  itm = (struct yaca_item_st *) rad;
+	  goto end;
+	}
+      struct yaca_itemslab_st *slab = item_new_slab (cl, lane);
+      ad = (char *) slab->isl_items;
+      mag->imag_end[cl][lane] = (char *) slab + YACA_ITEMSLAB_SIZE;
+    }
+  mag->imag_free[cl][lane] = ad + clsz;
+  // slabs are fresh mmap-ed memory, hence already zeroed
+  itm = (struct yaca_item_st *) ad;
+  goto end;
+end:
+  itm->itm_size = sz;
+  // locking then avoids looking at the type
+  if (yaca_typetab[typnum]->typ_flags & YACA_TYPEFLAG_SEQLOCK)
+    itm->itm_flags = YACA_ITEMFLAG_SEQLOCK;
+  return itm;
+}
+
+// give back the memory of reclaimed items
+static void
+item_release (struct yaca_item_st **itmarr, unsigned nb)
+{
+  pthread_mutex_lock (&yaca_itemslabs.mutex);
+  for (unsigned ix = 0; ix < nb; ix++)
+    {
+      struct yaca_item_st *itm = itmarr[ix];
+      size_t sz = itm->itm_size;
+      if (sz > YACA_ITEMSLAB_MAXSIZE)
+	{
+	  free (itm);
+	  continue;
+	}
+      unsigned cl = item_size_class (sz);
+      *(char **) itm = yaca_itemslabs.reclaimed[cl];
+      yaca_itemslabs.reclaimed[cl] = (char *) itm;
+    }
+  pthread_mutex_unlock (&yaca_itemslabs.mutex);
+}
+
+#define YACA_MARKBIT_REACHED 1
+#define YACA_MARKBIT_SCANNED 2
+
+// atomically set then clear some mark bits of an id in a table, and
+// return the previous ones
+static inline unsigned
+items_mark_apply (struct yaca_itemtable_st *tab, yaca_id_t id,
+		  unsigned setbits, unsigned clearbits)
+{
+  uint64_t bit = (uint64_t) 1 << (id % 64);
+  uint64_t *preached = tab->itab_reached + id / 64;
+  uint64_t *pscanned = tab->itab_scanned + id / 64;
+  uint64_t oldreached = 0, oldscanned = 0;
+  if (setbits & YACA_MARKBIT_REACHED)
+    oldreached = __atomic_fetch_or (preached, bit, __ATOMIC_SEQ_CST);
+  else if (clearbits & YACA_MARKBIT_REACHED)
+    oldreached = __atomic_fetch_and (preached, ~bit, __ATOMIC_SEQ_CST);
+  else
+    oldreached = __atomic_load_n (preached, __ATOMIC_SEQ_CST);
+  if (setbits & YACA_MARKBIT_SCANNED)
+    oldscanned = __atomic_fetch_or (pscanned, bit, __ATOMIC_SEQ_CST);
+  else if (clearbits & YACA_MARKBIT_SCANNED)
+    oldscanned = __atomic_fetch_and (pscanned, ~bit, __ATOMIC_SEQ_CST);
+  else
+    oldscanned = __atomic_load_n (pscanned, __ATOMIC_SEQ_CST);
+  return ((oldreached & bit) ? YACA_MARKBIT_REACHED : 0)
+    | ((oldscanned & bit) ? YACA_MARKBIT_SCANNED : 0);
+}
+
+// markers hold the table while marking, see yaca_items_read_begin,
+// so they do not enter the epoch for each update
+static unsigned
+items_mark_update (yaca_id_t id, unsigned setbits, unsigned clearbits)
+{
+  struct yaca_epochslot_st *slot = yaca_this_epochslot;
+  bool held = slot && slot->eps_depth > 0;
+  struct yaca_itemtable_st *tab = held
+    ? __atomic_load_n (&yaca_items.table, __ATOMIC_ACQUIRE)
+    : items_read_begin ();
+  unsigned old = items_mark_apply (tab, id, setbits, clearbits);
+  if (YACA_UNLIKELY (__atomic_load_n (&tab->itab_frozen, __ATOMIC_SEQ_CST)))
+    {
+      // the table was being copied, so update the new one too
+      pthread_mutex_lock (&yaca_items.mutex);
+      items_mark_apply (yaca_items.table, id, setbits, clearbits);
+      pthread_mutex_unlock (&yaca_items.mutex);
+    }
+  if (!held)
+    items_read_end ();
+  return old;
+}
+
+/** The items of each type, and of each space, are also kept in an
+   index, to enumerate them without scanning the whole item table. An
+   index is split in a few shards, each with its own mutex and its
+   vector of items, and each thread adds to its own shard, so makers
+   of items of the same type seldom contend. An item knows its shard
+   and its position in its type and space indexes, so it is removed by
+   moving the last item of the shard in its place.
+**/
+#define YACA_ITEMINDEX_SHARDS 8
+#define YACA_ITEMINDEX_POSBITS 29
+struct yaca_itemindex_st
+{
+  struct
+  {
+    pthread_mutex_t ixs_mutex;
+    unsigned ixs_len;
+    unsigned ixs_size;
+    struct yaca_item_st **ixs_arr;	/* of ixs_size entries */
+  } __attribute__ ((aligned (64))) ix_shards[YACA_ITEMINDEX_SHARDS];
+};
+static struct yaca_itemindex_st *yaca_typeindex[YACA_ITEM_MAX_TYPE];
+static struct yaca_itemindex_st *yaca_spaceindex[YACA_MAX_SPACE];
+static __thread unsigned yaca_this_indexshard;
+static unsigned yaca_nb_indexshards;
+
+// get an index, creating it if needed
+static struct yaca_itemindex_st *
+item_index (struct yaca_itemindex_st **pindex)
+{
+  struct yaca_itemindex_st *ix = __atomic_load_n (pindex, __ATOMIC_ACQUIRE);
+  if (YACA_LIKELY (ix != NULL))
+    return ix;
+  struct yaca_itemindex_st *newix = NULL;
+  if (posix_memalign ((void **) &newix, 64, sizeof (*newix)))
+    YACA_FATAL ("failed to allocate item index");
+  memset (newix, 0, sizeof (*newix));
+  for (unsigned sh = 0; sh < YACA_ITEMINDEX_SHARDS; sh++)
+    pthread_mutex_init (&newix->ix_shards[sh].ixs_mutex, NULL);
+  if (__atomic_compare_exchange_n (pindex, &ix, newix, false,
+				   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    return newix;
+  // another thread created it first
+  for (unsigned sh = 0; sh < YACA_ITEMINDEX_SHARDS; sh++)
+    pthread_mutex_destroy (&newix->ix_shards[sh].ixs_mutex);
+  free (newix);
+  return ix;
+}
+
+// add an item to the shard of the current thread, and store its shard
+// and position at the given offset in the item header, under the shard
+// mutex since a removal may move it at once
+static void
+item_index_add (struct yaca_itemindex_st **pindex, struct yaca_item_st *itm,
+		size_t posoff)
+{
+  struct yaca_itemindex_st *ix = item_index (pindex);
+  if (YACA_UNLIKELY (yaca_this_indexshard == 0))
+    yaca_this_indexshard =
+      __atomic_add_fetch (&yaca_nb_indexshards, 1, __ATOMIC_RELAXED);
+  unsigned sh = yaca_this_indexshard % YACA_ITEMINDEX_SHARDS;
+  pthread_mutex_lock (&ix->ix_shards[sh].ixs_mutex);
+  {
+    unsigned len = ix->ix_shards[sh].ixs_len;
+    if (YACA_UNLIKELY (len >= ix->ix_shards[sh].ixs_size))
+      {
+	unsigned newsiz = ((3 * len / 2 + 30) | 0x1f) + 1;
+	if (newsiz >= 1U << YACA_ITEMINDEX_POSBITS)
+	  YACA_FATAL ("too many items in index shard");
+	struct yaca_item_st **newarr =
+	  realloc (ix->ix_shards[sh].ixs_arr,
+		   newsiz * sizeof (struct yaca_item_st *));
+	if (!newarr)
+	  YACA_FATAL ("failed to grow item index to %u", newsiz);
+	ix->ix_shards[sh].ixs_arr = newarr;
+	ix->ix_shards[sh].ixs_size = newsiz;
+      }
+    ix->ix_shards[sh].ixs_arr[len] = itm;
+    ix->ix_shards[sh].ixs_len = len + 1;
+    *(uint32_t *) ((char *) itm + posoff) =
+      (sh << YACA_ITEMINDEX_POSBITS) | len;
+  }
+  pthread_mutex_unlock (&ix->ix_shards[sh].ixs_mutex);
+}
+
+// remove an item from an index, given the offset of its position in
+// the item header; its shard never changes, but its position is read
+// under the shard mutex, since removing another item may move it
+static void
+item_index_remove (struct yaca_itemindex_st *ix, struct yaca_item_st *itm,
+		   size_t posoff)
+{
+  uint32_t *ppos = (uint32_t *) ((char *) itm + posoff);
+  unsigned sh = __atomic_load_n (ppos, __ATOMIC_RELAXED)
+    >> YACA_ITEMINDEX_POSBITS;
+  assert (ix != NULL && sh < YACA_ITEMINDEX_SHARDS);
+  pthread_mutex_lock (&ix->ix_shards[sh].ixs_mutex);
+  {
+    uint32_t pos = *ppos;
+    unsigned ixpos = pos & ((1U << YACA_ITEMINDEX_POSBITS) - 1);
+    unsigned last = --ix->ix_shards[sh].ixs_len;
+    struct yaca_item_st **arr = ix->ix_shards[sh].ixs_arr;
+    assert (ixpos <= last && arr[ixpos] == itm);
+    struct yaca_item_st *lastitm = arr[last];
+    arr[ixpos] = lastitm;
+    arr[last] = NULL;
+    *(uint32_t *) ((char *) lastitm + posoff) = pos;
+  }
+  pthread_mutex_unlock (&ix->ix_shards[sh].ixs_mutex);
+}
+
+// index an item before publishing it in the item table, so whoever
+// finds it there may destroy it
+static void
+items_index_add (struct yaca_item_st *itm)
+{
+  item_index_add (yaca_typeindex + itm->itm_typnum, itm,
+		  offsetof (struct yaca_item_st, itm_typix));
+  item_index_add (yaca_spaceindex + itm->itm_spacnum, itm,
+		  offsetof (struct yaca_item_st, itm_spaix));
+}
+
+// iterate on the items of an index, shard by shard, while pinned
+static unsigned long
+items_index_iterate (struct yaca_itemindex_st *ix,
+		     bool (*fun) (struct yaca_item_st *, void *), void *data)
+{
+  unsigned long nb = 0;
+  struct yaca_item_st **buf = NULL;
+  unsigned bufsiz = 0;
+  if (!ix)
+    return 0;
+  yaca_items_pin ();
+  for (unsigned sh = 0; sh < YACA_ITEMINDEX_SHARDS; sh++)
+    {
+      // copy the shard, so the function can make or destroy items
+      pthread_mutex_lock (&ix->ix_shards[sh].ixs_mutex);
+      unsigned len = ix->ix_shards[sh].ixs_len;
+      if (len > bufsiz)
+	{
+	  bufsiz = len + len / 8 + 10;
+	  free (buf);
+	  buf = malloc (bufsiz * sizeof (struct yaca_item_st *));
+	  if (!buf)
+	    YACA_FATAL ("failed to allocate item index buffer of %u",
+			bufsiz);
+	}
+      if (len > 0)
+	memcpy (buf, ix->ix_shards[sh].ixs_arr,
+		len * sizeof (struct yaca_item_st *));
+      pthread_mutex_unlock (&ix->ix_shards[sh].ixs_mutex);
+      for (unsigned i = 0; i < len; i++)
+	{
+	  nb++;
+	  if (fun && !(*fun) (buf[i], data))
+	    goto end;
+	}
+    }
+  goto end;
+end:
+  yaca_items_unpin ();
+  free (buf);
+  return nb;
+}
+
+unsigned long
+yaca_items_of_type (yaca_typenum_t typnum,
+		    bool (*fun) (struct yaca_item_st *, void *), void *data)
+{
+  if (!typnum || typnum >= YACA_ITEM_MAX_TYPE)
+    YACA_FATAL ("invalid type number %d", (int) typnum);
+  return items_index_iterate (__atomic_load_n (yaca_typeindex + typnum,
+					       __ATOMIC_ACQUIRE), fun, data);
+}
+
+unsigned long
+yaca_items_of_space (yaca_spacenum_t spacenum,
+		     bool (*fun) (struct yaca_item_st *, void *), void *data)
+{
+  if (spacenum >= YACA_MAX_SPACE)
+    YACA_FATAL ("invalid space number %d", (int) spacenum);
+  return items_index_iterate (__atomic_load_n (yaca_spaceindex + spacenum,
+					       __ATOMIC_ACQUIRE), fun, data);
+}
+
 struct yaca_item_st *
 yaca_item_make (yaca_typenum_t typnum,
 		yaca_spacenum_t spacenum, unsigned extrasize)
@@ -221,77 +1182,35 @@ yaca_item_make (yaca_typenum_t typnum,
     YACA_FATAL ("invalid total size %ld", (long) sz);
   if (spacenum && spacenum >= YACA_MAX_SPACE)
     YACA_FATAL ("invalid space number %d", (int) spacenum);
-  pthread_mutex_lock (&yaca_items.mutex);
-  {
-    yaca_id_t id = 0;
-    if (YACA_UNLIKELY (3 * yaca_items.count + 50 > 2 * yaca_items.sizarr))
-      {
-	yaca_id_t newsiz = ((3 * yaca_items.count / 2 + 300) | 0x1ff) + 1;
-	struct yaca_item_st **newarr =
-	  calloc (newsiz, sizeof (struct yaca_item_st *));
-	if (!newarr)
-	  YACA_FATAL ("failed to grow item array to %ld", (long) newsiz);
-	unsigned char *newmarkarr = calloc (newsiz, sizeof (char));
-	if (!newmarkarr)
-	  YACA_FATAL ("failed to grow mark array to %ld", (long) newsiz);
-	if (yaca_items.itemarr)
-	  {
-	    memcpy (newarr, yaca_items.itemarr,
-		    yaca_items.sizarr * sizeof (struct yaca_item_st *));
-	    free (yaca_items.itemarr);
-	  }
-	yaca_items.itemarr = newarr;
-	if (yaca_items.markarr)
-	  {
-	    memcpy (newmarkarr, yaca_items.markarr,
-		    yaca_items.sizarr * sizeof (char));
-	    free (yaca_items.markarr);
-	  }
-	yaca_items.markarr = newmarkarr;
-	yaca_items.sizarr = newsiz;
-      };
-    if (yaca_typetab[typnum] == NULL)
-      YACA_FATAL ("undefined type number %d", (int) typnum);
-    if (spacenum && YACA_UNLIKELY (yaca_spacetab[spacenum] == NULL))
-      YACA_FATAL ("undefined space number %d", (int) spacenum);
-    do
-      {
-	long candid = 0;
-	lrand48_r (&yaca_items.r48data, &candid);
-	candid = candid % yaca_items.sizarr;
-	if (candid == 0)
-	  candid = 1 + yaca_items.count / 8;
-	if (yaca_items.itemarr[candid] == 0)
-	  id = candid;
-	else if (candid + 1 < yaca_items.sizarr
-		 && yaca_items.itemarr[candid + 1] == 0)
-	  id = candid + 1;
-	else if (candid + 11 < yaca_items.sizarr
-		 && yaca_items.itemarr[candid + 11] == 0)
-	  id = candid + 11;
-	else if (candid + 3 < yaca_items.sizarr
-		 && yaca_items.itemarr[candid + 3] == 0)
-	  id = candid + 3;
-	else if (candid + 19 < yaca_items.sizarr
-		 && yaca_items.itemarr[candid + 19] == 0)
-	  id = candid + 19;
-      }
-    while (YACA_UNLIKELY (id == 0));
-    itm = calloc (1, sz);
-    if (!itm)
-      YACA_FATAL ("failed to allocate item of %d bytes", (int) sz);
-    itm->itm_id = id;
-    itm->itm_typnum = typnum;
-    itm->itm_spacnum = spacenum;
-    pthread_mutex_init (&itm->itm_mutex, &yaca_items.mutexattr);
-    yaca_items.itemarr[id] = itm;
-    yaca_items.markarr[id] = 0;
-    itm->itm_magic = YACA_ITEM_MAGIC;
-    yaca_items.count++;
-    goto end;
-  }
-end:
-  pthread_mutex_unlock (&yaca_items.mutex);
+  if (YACA_UNLIKELY (yaca_typetab[typnum] == NULL))
+    YACA_FATAL ("undefined type number %d", (int) typnum);
+  if (spacenum && YACA_UNLIKELY (yaca_spacetab[spacenum] == NULL))
+    YACA_FATAL ("undefined space number %d", (int) spacenum);
+  itm = item_allocate (sz, typnum, spacenum);
+  yaca_id_t id = items_take_id ();
+  itm->itm_id = id;
+  itm->itm_typnum = typnum;
+  itm->itm_spacnum = spacenum;
+  itm->itm_magic = YACA_ITEM_MAGIC;
+  items_record_pinned (itm);
+  // items made while the GC is marking are allocated black
+  if (__atomic_load_n (&yaca_gc_marking, __ATOMIC_ACQUIRE))
+    items_mark_update (id, YACA_MARKBIT_REACHED | YACA_MARKBIT_SCANNED, 0);
+  else
+    items_mark_update (id, 0, YACA_MARKBIT_REACHED | YACA_MARKBIT_SCANNED);
+  items_index_add (itm);
+  struct yaca_itemtable_st *tab = items_read_begin ();
+  __atomic_store_n (tab->itab_arr + id, itm, __ATOMIC_SEQ_CST);
+  if (YACA_UNLIKELY (__atomic_load_n (&tab->itab_frozen, __ATOMIC_SEQ_CST)))
+    {
+      // the table was being copied, so store again in the new one
+      pthread_mutex_lock (&yaca_items.mutex);
+      __atomic_store_n (yaca_items.table->itab_arr + id, itm,
+			__ATOMIC_RELEASE);
+      pthread_mutex_unlock (&yaca_items.mutex);
+    }
+  items_read_end ();
+  __atomic_fetch_add (&yaca_items.count, 1, __ATOMIC_RELAXED);
   return itm;
 }
 
@@ -311,64 +1230,442 @@ yaca_item_build (yaca_typenum_t typnum, yaca_spacenum_t spacenum,
     YACA_FATAL ("zero id for item build");
   if (spacenum && spacenum >= YACA_MAX_SPACE)
     YACA_FATAL ("invalid space number %d", (int) spacenum);
+  if (YACA_UNLIKELY (yaca_typetab[typnum] == NULL))
+    YACA_FATAL ("unexistent type number %d", (int) typnum);
+  if (spacenum && YACA_UNLIKELY (yaca_spacetab[spacenum] == NULL))
+    YACA_FATAL ("undefined space number %d", (int) spacenum);
+  itm = item_allocate (sz, typnum, spacenum);
+  itm->itm_id = id;
+  itm->itm_typnum = typnum;
+  itm->itm_spacnum = spacenum;
+  itm->itm_magic = YACA_ITEM_MAGIC;
+  items_record_pinned (itm);
+  items_index_add (itm);
   pthread_mutex_lock (&yaca_items.mutex);
   {
     if (YACA_UNLIKELY (id >= yaca_items.sizarr))
+      items_grow (((id + yaca_items.count / 4 + 100) | 0x1ff) + 1);
+    struct yaca_itemtable_st *tab = yaca_items.table;
+    uint64_t idbit = (uint64_t) 1 << (id % 64);
+    if (YACA_UNLIKELY (tab->itab_used[id / 64] & idbit))
       {
-	yaca_id_t newsiz = ((id + yaca_items.count / 4 + 100) | 0x1ff) + 1;
-	struct yaca_item_st **newarr =
-	  calloc (newsiz, sizeof (struct yaca_item_st *));
-	if (!newarr)
-	  YACA_FATAL ("failed to grow item array to %ld", (long) newsiz);
-	if (yaca_items.itemarr)
-	  {
-	    memcpy (newarr, yaca_items.itemarr,
-		    yaca_items.sizarr * sizeof (struct yaca_item_st *));
-	    free (yaca_items.itemarr);
-	  }
-	yaca_items.itemarr = newarr;
-	yaca_items.sizarr = newsiz;
+	// a reserved id is taken from its block
+	if (!items_unreserve_id (id))
+	  YACA_FATAL ("already used id %ld", (long) id);
       }
-    if (YACA_UNLIKELY (yaca_items.itemarr[id] != NULL))
-      YACA_FATAL ("already used id %ld", (long) id);
-    if (YACA_UNLIKELY (yaca_typetab[typnum] == NULL))
-      YACA_FATAL ("unexistent type number %d", (int) typnum);
-    if (spacenum && YACA_UNLIKELY (yaca_spacetab[spacenum] == NULL))
-      YACA_FATAL ("undefined space number %d", (int) spacenum);
-    itm = calloc (1, sz);
-    if (!itm)
-      YACA_FATAL ("failed to allocate item of %d bytes", (int) sz);
-    itm->itm_id = id;
-    itm->itm_typnum = typnum;
-    itm->itm_spacnum = spacenum;
-    pthread_mutex_init (&itm->itm_mutex, &yaca_items.mutexattr);
-    yaca_items.itemarr[id] = itm;
-    yaca_items.markarr[id] = 0;
-    itm->itm_magic = YACA_ITEM_MAGIC;
-    yaca_items.count++;
+    else
+      {
+	__atomic_fetch_or (tab->itab_used + id / 64, idbit, __ATOMIC_RELAXED);
+	yaca_items.nbtaken++;
+      }
+    // items made while the GC is marking are allocated black; the table
+    // cannot be copied while we hold the mutex
+    if (__atomic_load_n (&yaca_gc_marking, __ATOMIC_ACQUIRE))
+      items_mark_apply (tab, id,
+			YACA_MARKBIT_REACHED | YACA_MARKBIT_SCANNED, 0);
+    else
+      items_mark_apply (tab, id, 0,
+			YACA_MARKBIT_REACHED | YACA_MARKBIT_SCANNED);
+    __atomic_store_n (tab->itab_arr + id, itm, __ATOMIC_RELEASE);
+    __atomic_fetch_add (&yaca_items.count, 1, __ATOMIC_RELAXED);
     goto end;
   }
 end:
   pthread_mutex_unlock (&yaca_items.mutex);
+  epoch_reclaim ();
   return itm;
 }
 
+void
+yaca_item_destroy (struct yaca_item_st *itm)
+{
+  if (itm)
+    yaca_items_destroy (&itm, 1);
+}
+
+// destroy items, skipping and removing from the array those already
+// destroyed by another thread; that is fatal unless one was the sweep
+static unsigned
+items_destroy (struct yaca_item_st **itmarr, unsigned nb, bool sweeping)
+{
+  unsigned nbclaimed = 0;
+  uint32_t claim = YACA_ITEMFLAG_DESTROYED
+    | (sweeping ? YACA_ITEMFLAG_SWEPT : 0);
+  for (unsigned ix = 0; ix < nb; ix++)
+    {
+      struct yaca_item_st *itm = itmarr[ix];
+      if (YACA_UNLIKELY (!itm || itm->itm_magic != YACA_ITEM_MAGIC))
+	YACA_FATAL ("destroying invalid item @%p", itm);
+      // claim it before touching the agenda and the indexes
+      uint32_t oldflags = __atomic_fetch_or (&itm->itm_flags, claim,
+					     __ATOMIC_ACQ_REL);
+      if (YACA_UNLIKELY (oldflags & YACA_ITEMFLAG_DESTROYED))
+	{
+	  if (!sweeping && !(oldflags & YACA_ITEMFLAG_SWEPT))
+	    YACA_FATAL ("item #%ld destroyed twice", (long) itm->itm_id);
+	  continue;
+	}
+      itmarr[nbclaimed++] = itm;
+      yaca_agenda_remove (itm);
+      // wait for the threads currently holding its lock
+      yaca_item_lock (itm);
+      item_index_remove (yaca_typeindex[itm->itm_typnum], itm,
+			 offsetof (struct yaca_item_st, itm_typix));
+      item_index_remove (yaca_spaceindex[itm->itm_spacnum], itm,
+			 offsetof (struct yaca_item_st, itm_spaix));
+      yaca_item_unlock (itm);
+    }
+  nb = nbclaimed;
+  if (nb == 0)
+    return 0;
+  pthread_mutex_lock (&yaca_items.mutex);
+  {
+    // the table cannot be copied while we hold the mutex
+    struct yaca_itemtable_st *tab = yaca_items.table;
+    struct yaca_deaditems_st *dying = yaca_items.dying;
+    if (YACA_UNLIKELY (!dying || dying->dit_len + nb > dying->dit_size))
+      {
+	unsigned len = dying ? dying->dit_len : 0;
+	unsigned newsiz = 2 * (len + nb) + 30;
+	dying = realloc (dying, sizeof (struct yaca_deaditems_st)
+			 + newsiz * sizeof (struct yaca_item_st *));
+	if (!dying)
+	  YACA_FATAL ("failed to grow dying items to %u", newsiz);
+	dying->dit_len = len;
+	dying->dit_size = newsiz;
+	yaca_items.dying = dying;
+      }
+    for (unsigned ix = 0; ix < nb; ix++)
+      {
+	struct yaca_item_st *itm = itmarr[ix];
+	yaca_id_t id = itm->itm_id;
+	assert (id < tab->itab_size && tab->itab_arr[id] == itm);
+	__atomic_store_n (tab->itab_arr + id, NULL, __ATOMIC_RELEASE);
+	dying->dit_arr[dying->dit_len++] = itm;
+      }
+    __atomic_fetch_sub (&yaca_items.count, nb, __ATOMIC_RELAXED);
+    goto end;
+  }
+end:
+  pthread_mutex_unlock (&yaca_items.mutex);
+  epoch_reclaim ();
+  return nb;
+}
+
+void
+yaca_items_destroy (struct yaca_item_st **itmarr, unsigned nb)
+{
+  (void) items_destroy (itmarr, nb, false);
+}
+
+unsigned
+yaca_items_sweep (struct yaca_item_st **itmarr, unsigned nb)
+{
+  return items_destroy (itmarr, nb, true);
+}
+
+// reclaim retired dead items: free their ids then their memory
+static void
+items_reclaim (void *ptr)
+{
+  struct yaca_deaditems_st *dead = ptr;
+  pthread_mutex_lock (&yaca_items.mutex);
+  struct yaca_itemtable_st *tab = yaca_items.table;
+  for (unsigned ix = 0; ix < dead->dit_len; ix++)
+    {
+      yaca_id_t id = dead->dit_arr[ix]->itm_id;
+      uint64_t nobit = ~((uint64_t) 1 << (id % 64));
+      __atomic_fetch_and (tab->itab_used + id / 64, nobit, __ATOMIC_RELAXED);
+      __atomic_fetch_and (tab->itab_reached + id / 64, nobit,
+			  __ATOMIC_RELAXED);
+      __atomic_fetch_and (tab->itab_scanned + id / 64, nobit,
+			  __ATOMIC_RELAXED);
+    }
+  yaca_items.nbtaken -= dead->dit_len;
+  pthread_mutex_unlock (&yaca_items.mutex);
+  item_release (dead->dit_arr, dead->dit_len);
+  free (dead);
+}
+
+void
+yaca_items_retire_destroyed (void)
+{
+  pthread_mutex_lock (&yaca_items.mutex);
+  struct yaca_deaditems_st *dying = yaca_items.dying;
+  yaca_items.dying = NULL;
+  pthread_mutex_unlock (&yaca_items.mutex);
+  if (dying)
+    epoch_retire (dying, items_reclaim);
+  epoch_reclaim ();
+}
+
+__thread uint32_t yaca_this_locker;
+static uint32_t yaca_nb_lockers;
+
+// locks deeper than YACA_ITEMLOCK_DEPTHMAX, held by this thread
+#define YACA_DEEPLOCKS_LEN 8
+static __thread struct
+{
+  struct yaca_item_st *dlk_item;
+  unsigned long dlk_depth;
+} yaca_this_deeplocks[YACA_DEEPLOCKS_LEN];
+
+static inline long
+item_futex (uint32_t * addr, int op, uint32_t val)
+{
+  return syscall (SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+void
+yaca_item_lock_slow (struct yaca_item_st *itm)
+{
+  if (YACA_UNLIKELY (yaca_this_locker == 0))
+    {
+      yaca_this_locker =
+	__atomic_add_fetch (&yaca_nb_lockers, 1, __ATOMIC_RELAXED);
+      if (yaca_this_locker >= 1U << (32 - YACA_ITEMLOCK_OWNERSHIFT))
+	YACA_FATAL ("too many locking threads");
+    }
+  uint32_t self = yaca_this_locker << YACA_ITEMLOCK_OWNERSHIFT;
+  uint32_t w = __atomic_load_n (&itm->itm_lock, __ATOMIC_RELAXED);
+  if ((w >> YACA_ITEMLOCK_OWNERSHIFT) == yaca_this_locker)
+    {
+      // recursive locking; only the owner changes the depth
+      unsigned depth = (w >> YACA_ITEMLOCK_DEPTHSHIFT) & YACA_ITEMLOCK_DEPTHMAX;
+      if (YACA_LIKELY (depth < YACA_ITEMLOCK_DEPTHMAX))
+	{
+	  __atomic_fetch_add (&itm->itm_lock, 1 << YACA_ITEMLOCK_DEPTHSHIFT,
+			      __ATOMIC_RELAXED);
+	  return;
+	}
+      int freeix = -1;
+      for (int ix = 0; ix < YACA_DEEPLOCKS_LEN; ix++)
+	if (yaca_this_deeplocks[ix].dlk_item == itm)
+	  {
+	    yaca_this_deeplocks[ix].dlk_depth++;
+	    return;
+	  }
+	else if (freeix < 0 && !yaca_this_deeplocks[ix].dlk_item)
+	  freeix = ix;
+      if (freeix < 0)
+	YACA_FATAL ("too many deeply locked items");
+      yaca_this_deeplocks[freeix].dlk_item = itm;
+      yaca_this_deeplocks[freeix].dlk_depth = 1;
+      return;
+    }
+  // spin a little before waiting
+  for (int cnt = 0; cnt < 64; cnt++)
+    {
+      uint32_t zero = 0;
+      if (__atomic_compare_exchange_n (&itm->itm_lock, &zero, self, false,
+				       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	{
+	  yaca_item_seq_write_begin (itm);
+	  return;
+	}
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause ();
+#endif
+    }
+  for (;;)
+    {
+      w = __atomic_load_n (&itm->itm_lock, __ATOMIC_RELAXED);
+      if (w == 0)
+	{
+	  // others may be waiting too, so keep the lock contended
+	  if (__atomic_compare_exchange_n (&itm->itm_lock, &w,
+					   self | YACA_ITEMLOCK_CONTENDED,
+					   false, __ATOMIC_ACQUIRE,
+					   __ATOMIC_RELAXED))
+	    {
+	      yaca_item_seq_write_begin (itm);
+	      return;
+	    }
+	  continue;
+	}
+      if (!(w & YACA_ITEMLOCK_CONTENDED)
+	  && !__atomic_compare_exchange_n (&itm->itm_lock, &w,
+					   w | YACA_ITEMLOCK_CONTENDED,
+					   false, __ATOMIC_RELAXED,
+					   __ATOMIC_RELAXED))
+	continue;
+      item_futex (&itm->itm_lock, FUTEX_WAIT_PRIVATE,
+		  w | YACA_ITEMLOCK_CONTENDED);
+    }
+}
+
+void
+yaca_item_unlock_slow (struct yaca_item_st *itm)
+{
+  uint32_t w = __atomic_load_n (&itm->itm_lock, __ATOMIC_RELAXED);
+  if (YACA_UNLIKELY ((w >> YACA_ITEMLOCK_OWNERSHIFT) != yaca_this_locker
+		     || yaca_this_locker == 0))
+    YACA_FATAL ("unlocking item #%ld not locked by this thread",
+		(long) itm->itm_id);
+  if ((w >> YACA_ITEMLOCK_DEPTHSHIFT) & YACA_ITEMLOCK_DEPTHMAX)
+    {
+      for (int ix = 0; ix < YACA_DEEPLOCKS_LEN; ix++)
+	if (yaca_this_deeplocks[ix].dlk_item == itm)
+	  {
+	    if (--yaca_this_deeplocks[ix].dlk_depth == 0)
+	      yaca_this_deeplocks[ix].dlk_item = NULL;
+	    return;
+	  }
+      __atomic_fetch_sub (&itm->itm_lock, 1 << YACA_ITEMLOCK_DEPTHSHIFT,
+			  __ATOMIC_RELAXED);
+      return;
+    }
+  // the inline fast path may already have ended the write section
+  // before losing its race with a waiter
+  if (yaca_item_is_seqlocked (itm) && (itm->itm_seq & 1))
+    yaca_item_seq_write_end (itm);
+  w = __atomic_exchange_n (&itm->itm_lock, 0, __ATOMIC_RELEASE);
+  if (w & YACA_ITEMLOCK_CONTENDED)
+    item_futex (&itm->itm_lock, FUTEX_WAKE_PRIVATE, 1);
+}
+
 struct yaca_item_st *
 yaca_item_of_id (yaca_id_t id)
 {
   struct yaca_item_st *itm = NULL;
   if (id == 0)
     return NULL;
-  pthread_mutex_lock (&yaca_items.mutex);
-  if (id > 0 && id < yaca_items.sizarr)
-    itm = yaca_items.itemarr[id];
+  struct yaca_itemtable_st *tab = items_read_begin ();
+  if (id > 0 && id < tab->itab_size)
+    itm = __atomic_load_n (tab->itab_arr + id, __ATOMIC_ACQUIRE);
   goto end;
-  assert (!itm || (itm->itm_magic == YACA_ITEM_MAGIC && itm->itm_id == id));
 end:
-  pthread_mutex_unlock (&yaca_items.mutex);
+  items_read_end ();
+  assert (!itm || (itm->itm_magic == YACA_ITEM_MAGIC && itm->itm_id == id));
+  if (YACA_UNLIKELY (itm && yaca_this_epochslot
+		     && yaca_this_epochslot->eps_pindepth > 0))
+    {
+      // recorded before asking the GC, as for a new item
+      items_record_pinned (itm);
+      if (!yaca_gc_keep_item (itm))
+	itm = NULL;
+    }
   return itm;
 }
 
+bool
+yaca_item_shade (struct yaca_item_st *itm)
+{
+  return !(items_mark_update (itm->itm_id, YACA_MARKBIT_REACHED, 0)
+	   & YACA_MARKBIT_REACHED);
+}
+
+bool
+yaca_item_blacken (struct yaca_item_st *itm)
+{
+  return !(items_mark_update (itm->itm_id,
+			      YACA_MARKBIT_REACHED | YACA_MARKBIT_SCANNED, 0)
+	   & YACA_MARKBIT_SCANNED);
+}
+
+bool
+yaca_item_regrey (struct yaca_item_st *itm)
+{
+  // a white item stays white
+  if (!yaca_item_is_marked (itm))
+    return false;
+  items_mark_update (itm->itm_id, 0, YACA_MARKBIT_SCANNED);
+  return true;
+}
+
+bool
+yaca_item_is_marked (struct yaca_item_st *itm)
+{
+  return (items_mark_update (itm->itm_id, 0, 0) & YACA_MARKBIT_REACHED) != 0;
+}
+
+void
+yaca_items_clear_marks (void)
+{
+  pthread_mutex_lock (&yaca_items.mutex);
+  struct yaca_itemtable_st *tab = yaca_items.table;
+  for (yaca_id_t w = 0; w < tab->itab_size / 64; w++)
+    {
+      __atomic_store_n (tab->itab_reached + w, 0, __ATOMIC_RELAXED);
+      __atomic_store_n (tab->itab_scanned + w, 0, __ATOMIC_RELAXED);
+    }
+  pthread_mutex_unlock (&yaca_items.mutex);
+}
+
+yaca_id_t
+yaca_items_bound (void)
+{
+  // the size of a table is never changed, only the table
+  yaca_id_t bound = 0;
+  struct yaca_itemtable_st *tab = items_read_begin ();
+  bound = tab->itab_size;
+  items_read_end ();
+  return bound;
+}
+
+unsigned
+yaca_items_in_range (yaca_id_t lo, yaca_id_t hi, struct yaca_item_st **buf)
+{
+  unsigned nb = 0;
+  if (lo == 0)
+    lo = 1;
+  struct yaca_itemtable_st *tab = items_read_begin ();
+  if (hi > tab->itab_size)
+    hi = tab->itab_size;
+  for (yaca_id_t id = lo; id < hi; id++)
+    {
+      struct yaca_item_st *itm =
+	__atomic_load_n (tab->itab_arr + id, __ATOMIC_ACQUIRE);
+      if (itm)
+	buf[nb++] = itm;
+    }
+  items_read_end ();
+  return nb;
+}
+
+unsigned
+yaca_items_unmarked_in_range (yaca_id_t lo, yaca_id_t hi,
+			      struct yaca_item_st **buf)
+{
+  unsigned nb = 0;
+  struct yaca_itemtable_st *tab = items_read_begin ();
+  if (hi > tab->itab_size)
+    hi = tab->itab_size;
+  const uint64_t *used = tab->itab_used;
+  const uint64_t *reached = tab->itab_reached;
+  yaca_id_t wlo = lo / 64, whi = (hi + 63) / 64;
+  for (yaca_id_t w = wlo; w < whi; w += 8)
+    {
+      // skip quickly, with vectorizable code, the blocks of eight words
+      // whose used ids are all marked
+      if (YACA_LIKELY (w + 8 <= whi))
+	{
+	  uint64_t acc = 0;
+	  for (unsigned k = 0; k < 8; k++)
+	    acc |= used[w + k] & ~reached[w + k];
+	  if (YACA_LIKELY (acc == 0))
+	    continue;
+	}
+      for (yaca_id_t v = w; v < w + 8 && v < whi; v++)
+	{
+	  uint64_t unmarked = used[v] & ~reached[v];
+	  while (unmarked)
+	    {
+	      yaca_id_t id = v * 64 + __builtin_ctzll (unmarked);
+	      unmarked &= unmarked - 1;
+	      if (id < lo || id >= hi)
+		continue;
+	      struct yaca_item_st *itm =
+		__atomic_load_n (tab->itab_arr + id, __ATOMIC_ACQUIRE);
+	      // reserved ids have no item yet
+	      if (itm)
+		buf[nb++] = itm;
+	    }
+	}
+    }
+  items_read_end ();
+  return nb;
+}
 
 /* table of primes with about 10% progression */
 static const unsigned long yaca_primetab[512] =
@@ -434,10 +1731,131 @@ yaca_prime_after (unsigned long l)
 }
 
 
+/** The write barrier records touched items in a sequential store
+   buffer of the worker, flushed by batches into the global remembered
+   set, so a collector can scan only the touched items. Other threads
+   add directly to the remembered set.
+**/
+static struct
+{
+  pthread_mutex_t mutex;
+  unsigned len;
+  unsigned size;
+  struct yaca_item_st **arr;	/* of size elements */
+  unsigned long barrierhits;	/* of non-worker threads */
+  unsigned long maxflush;
+} yaca_remembered =
+{
+PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL, 0, 0};
+
+// add items to the remembered set, with its mutex held
+static void
+remember_items (struct yaca_item_st **itms, unsigned nb)
+{
+  if (YACA_UNLIKELY (yaca_remembered.len + nb >= yaca_remembered.size))
+    {
+      unsigned newsiz = ((3 * (yaca_remembered.len + nb) / 2 + 500)
+			 | 0xff) + 1;
+      struct yaca_item_st **newarr =
+	realloc (yaca_remembered.arr, newsiz * sizeof (struct yaca_item_st *));
+      if (!newarr)
+	YACA_FATAL ("failed to grow remembered set to %u", newsiz);
+      yaca_remembered.arr = newarr;
+      yaca_remembered.size = newsiz;
+    }
+  memcpy (yaca_remembered.arr + yaca_remembered.len, itms,
+	  nb * sizeof (struct yaca_item_st *));
+  yaca_remembered.len += nb;
+  if (nb > yaca_remembered.maxflush)
+    yaca_remembered.maxflush = nb;
+}
+
+static void
+flush_worker_touched (struct yaca_worker_st *wrk)
+{
+  unsigned nb = wrk->worker_storelen;
+  if (nb == 0)
+    return;
+  pthread_mutex_lock (&yaca_remembered.mutex);
+  remember_items (wrk->worker_storebuf, nb);
+  pthread_mutex_unlock (&yaca_remembered.mutex);
+  wrk->worker_storelen = 0;
+  wrk->worker_touchflushes++;
+  wrk->worker_touchflushed += nb;
+}
+
+void
+yaca_flush_touched (void)
+{
+  if (yaca_this_worker && yaca_this_worker->worker_num > 0)
+    flush_worker_touched (yaca_this_worker);
+}
+
 void
 yaca_item_really_touch (struct yaca_item_st *itm)
 {
-#warning unimplemented yaca_item_really_touch
+  struct yaca_worker_st *wrk = yaca_this_worker;
+  if (YACA_LIKELY (wrk && wrk->worker_num > 0))
+    {
+      yaca_id_t id = itm->itm_id;
+      unsigned cix = id % YACA_WORKER_TOUCH_CACHE_LEN;
+      if (wrk->worker_touchcache[cix] != NULL)
+	cix = (id + 1) % YACA_WORKER_TOUCH_CACHE_LEN;
+      wrk->worker_touchcache[cix] = itm;
+      wrk->worker_storebuf[wrk->worker_storelen++] = itm;
+      wrk->worker_touchbarrierhits++;
+      if (YACA_UNLIKELY
+	  (wrk->worker_storelen >= YACA_WORKER_STORE_BUFFER_LEN))
+	flush_worker_touched (wrk);
+      return;
+    }
+  pthread_mutex_lock (&yaca_remembered.mutex);
+  remember_items (&itm, 1);
+  yaca_remembered.barrierhits++;
+  pthread_mutex_unlock (&yaca_remembered.mutex);
+}
+
+unsigned
+yaca_remembered_set_take (struct yaca_item_st ***parr)
+{
+  unsigned len = 0;
+  // the workers are at a safepoint, so we can flush their buffers
+  for (unsigned wix = 1; wix <= yaca_nb_workers; wix++)
+    {
+      struct yaca_worker_st *wrk = yaca_worktab + wix;
+      flush_worker_touched (wrk);
+      memset (wrk->worker_touchcache, 0, sizeof (wrk->worker_touchcache));
+    }
+  pthread_mutex_lock (&yaca_remembered.mutex);
+  len = yaca_remembered.len;
+  if (parr)
+    *parr = yaca_remembered.arr;
+  else
+    free (yaca_remembered.arr);
+  yaca_remembered.arr = NULL;
+  yaca_remembered.len = yaca_remembered.size = 0;
+  pthread_mutex_unlock (&yaca_remembered.mutex);
+  return len;
+}
+
+void
+yaca_barrier_stats (struct yaca_barrier_stats_st *st)
+{
+  if (!st)
+    return;
+  memset (st, 0, sizeof (*st));
+  for (unsigned wix = 1; wix <= yaca_nb_workers; wix++)
+    {
+      struct yaca_worker_st *wrk = yaca_worktab + wix;
+      st->bst_cachehits += wrk->worker_touchcachehits;
+      st->bst_barrierhits += wrk->worker_touchbarrierhits;
+      st->bst_flushes += wrk->worker_touchflushes;
+      st->bst_flushed += wrk->worker_touchflushed;
+    }
+  pthread_mutex_lock (&yaca_remembered.mutex);
+  st->bst_barrierhits += yaca_remembered.barrierhits;
+  st->bst_maxflush = yaca_remembered.maxflush;
+  pthread_mutex_unlock (&yaca_remembered.mutex);
 }
 
 int
@@ -450,6 +1868,14 @@ main (int argc, char **argv)
     yaca_nb_workers = 2;
   else if (yaca_nb_workers > YACA_MAX_WORKERS)
     yaca_nb_workers = YACA_MAX_WORKERS;
+  if (yaca_regpool_high_megabytes < 0)
+    yaca_regpool_high_megabytes = 0;
+  if (yaca_regpool_low_megabytes > yaca_regpool_high_megabytes)
+    yaca_regpool_low_megabytes = yaca_regpool_high_megabytes;
+  if (yaca_gc_growth_factor < 1.1)
+    yaca_gc_growth_factor = 1.1;
+  if (yaca_gc_heapcap_megabytes < 0)
+    yaca_gc_heapcap_megabytes = 0;
   initialize_random ();
   if (nice_level)
     nice (nice_level);
@@ -483,4 +1909,5 @@ main (int argc, char **argv)
     }
   yaca_initialize_memgc ();
   initialize_items ();
+  return 0;
 }
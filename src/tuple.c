@@ -0,0 +1,231 @@
+/** file yacasys/src/tuple.c
+
+     Copyright (C) 2013 Basile Starynkevitch <basile@starynkevitch.net>
+
+     This file is part of YacaSys
+
+      YacaSys is free software; you can redistribute it and/or modify
+      it under the terms of the GNU General Public License as published by
+      the Free Software Foundation; either version 3, or (at your option)
+      any later version.
+
+      YacaSys is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+      GNU General Public License for more details.
+
+      You should have received a copy of the GNU General Public License
+      along with YacaSys; see the file COPYING3.   If not see
+      <http://www.gnu.org/licenses/>.
+
+**/
+
+#include "yaca.h"
+
+/** Hash-consed tuples are kept in a weak table, split in stripes
+   chosen by the high bits of the hash, each with its own mutex and
+   open addressing array. The table does not keep its tuples alive:
+   after copying, the workers call yaca_tuples_gc_fixup on every
+   stripe, which keeps only the forwarded tuples, at their new
+   address. Since tuples are keyed by the addresses of their items,
+   the tuples mentioning a destroyed item are forgotten too, before
+   its memory can be reused by another item.
+**/
+#define YACA_TUPLE_MINSIZE 64
+static struct
+{
+  pthread_mutex_t mutex;
+  unsigned count;
+  unsigned size;		/* a power of two, or 0 */
+  struct yaca_tupleitems_st **arr;	/* of size entries */
+} __attribute__ ((aligned (64))) yaca_tuplestripes[YACA_TUPLE_STRIPES] =
+{
+  [0 ... YACA_TUPLE_STRIPES - 1] =
+  {
+  PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL}
+};
+
+// the hash of some items, never 0
+static unsigned
+tuple_hash (unsigned len, struct yaca_item_st **items)
+{
+  unsigned h = len * 617 + 11;
+  for (unsigned ix = 0; ix < len; ix++)
+    {
+      yaca_id_t id = items[ix] ? items[ix]->itm_id : 0;
+      h = (h * 1000003) ^ (id * 3001 + ix);
+    }
+  h ^= h >> 15;
+  if (YACA_UNLIKELY (h == 0))
+    h = len + 1;
+  return h;
+}
+
+static struct yaca_tupleitems_st *
+tuple_allocate (unsigned len, struct yaca_item_st **items, unsigned hash)
+{
+  struct yaca_tupleitems_st *tup =
+    yaca_work_allocate (sizeof (struct yaca_tupleitems_st)
+			+ len * sizeof (struct yaca_item_st *));
+  if (!tup)
+    YACA_FATAL ("failed to allocate tuple of %u items", len);
+  tup->tup_len = len;
+  tup->tup_hash = hash;
+  if (len > 0)
+    memcpy (tup->tup_items, items, len * sizeof (struct yaca_item_st *));
+  return tup;
+}
+
+// put a tuple in an array of a stripe, which has room for it
+static void
+tuple_put (struct yaca_tupleitems_st **arr, unsigned size,
+	   struct yaca_tupleitems_st *tup)
+{
+  for (unsigned ix = tup->tup_hash & (size - 1);; ix = (ix + 1) & (size - 1))
+    if (!arr[ix])
+      {
+	arr[ix] = tup;
+	return;
+      }
+}
+
+// replace the array of a stripe, with its mutex held, by one of the
+// given size holding the tuples kept by the filter function
+static void
+tuple_stripe_rebuild (unsigned st, unsigned newsiz,
+		      void *(*filter) (void *))
+{
+  struct yaca_tupleitems_st **oldarr = yaca_tuplestripes[st].arr;
+  unsigned oldsiz = yaca_tuplestripes[st].size;
+  struct yaca_tupleitems_st **newarr =
+    calloc (newsiz, sizeof (struct yaca_tupleitems_st *));
+  if (!newarr)
+    YACA_FATAL ("failed to allocate tuple table of %u", newsiz);
+  unsigned count = 0;
+  for (unsigned ix = 0; ix < oldsiz; ix++)
+    {
+      struct yaca_tupleitems_st *tup = oldarr[ix];
+      if (tup && filter)
+	tup = (*filter) (tup);
+      if (!tup)
+	continue;
+      tuple_put (newarr, newsiz, tup);
+      count++;
+    }
+  free (oldarr);
+  yaca_tuplestripes[st].arr = newarr;
+  yaca_tuplestripes[st].size = newsiz;
+  yaca_tuplestripes[st].count = count;
+}
+
+struct yaca_tupleitems_st *
+yaca_tuple_make (unsigned len, struct yaca_item_st **items)
+{
+  if (len > 0 && !items)
+    YACA_FATAL ("no items for tuple of %u", len);
+  return tuple_allocate (len, items, tuple_hash (len, items));
+}
+
+struct yaca_tupleitems_st *
+yaca_tuple_cons (unsigned len, struct yaca_item_st **items)
+{
+  struct yaca_tupleitems_st *tup = NULL;
+  if (len > 0 && !items)
+    YACA_FATAL ("no items for tuple of %u", len);
+  unsigned hash = tuple_hash (len, items);
+  unsigned st = hash >> 28;
+  // while the workers copy, the stripes may still hold old addresses,
+  // so a thread other than the workers waits till the copy ends; it
+  // should itself be pinned to keep using the tuple, see yaca_items_pin
+  bool nonworker = !yaca_this_worker || yaca_this_worker->worker_num <= 0;
+  if (nonworker)
+    yaca_items_pin ();
+  pthread_mutex_lock (&yaca_tuplestripes[st].mutex);
+  {
+    unsigned size = yaca_tuplestripes[st].size;
+    struct yaca_tupleitems_st **arr = yaca_tuplestripes[st].arr;
+    if (size > 0)
+      for (unsigned ix = hash & (size - 1);
+	   (tup = arr[ix]) != NULL; ix = (ix + 1) & (size - 1))
+	if (tup->tup_hash == hash && tup->tup_len == len
+	    && !memcmp (tup->tup_items, items,
+			len * sizeof (struct yaca_item_st *)))
+	  goto end;
+    if (YACA_UNLIKELY (4 * (yaca_tuplestripes[st].count + 1) > 3 * size))
+      tuple_stripe_rebuild (st, size ? 2 * size : YACA_TUPLE_MINSIZE, NULL);
+    tup = tuple_allocate (len, items, hash);
+    tup->tup_consed = 1;
+    tuple_put (yaca_tuplestripes[st].arr, yaca_tuplestripes[st].size, tup);
+    yaca_tuplestripes[st].count++;
+    goto end;
+  }
+end:
+  pthread_mutex_unlock (&yaca_tuplestripes[st].mutex);
+  if (nonworker)
+    yaca_items_unpin ();
+  return tup;
+}
+
+bool
+yaca_tuple_equal (const struct yaca_tupleitems_st *tup1,
+		  const struct yaca_tupleitems_st *tup2)
+{
+  if (tup1 == tup2)
+    return true;
+  if (!tup1 || !tup2)
+    return false;
+  // hash-consed tuples are unique
+  if (tup1->tup_consed && tup2->tup_consed)
+    return false;
+  if (tup1->tup_hash != tup2->tup_hash || tup1->tup_len != tup2->tup_len)
+    return false;
+  return !memcmp (tup1->tup_items, tup2->tup_items,
+		  tup1->tup_len * sizeof (struct yaca_item_st *));
+}
+
+struct yaca_tupleitems_st *
+yaca_tuple_gcscan (struct yaca_tupleitems_st *tup)
+{
+  if (!tup)
+    return NULL;
+  for (unsigned ix = 0; ix < tup->tup_len; ix++)
+    yaca_gc_mark_item (tup->tup_items[ix]);
+  return yaca_gc_forward (tup);
+}
+
+// give the new address of a hash-consed tuple, or NULL if it died or
+// mentions some destroyed item
+static void *
+tuple_gc_keep (void *ptr)
+{
+  struct yaca_tupleitems_st *tup = yaca_gc_forwarded (ptr);
+  if (!tup)
+    return NULL;
+  for (unsigned ix = 0; ix < tup->tup_len; ix++)
+    {
+      struct yaca_item_st *itm = tup->tup_items[ix];
+      if (itm && yaca_item_of_id (itm->itm_id) != itm)
+	return NULL;
+    }
+  return tup;
+}
+
+void
+yaca_tuples_gc_fixup (unsigned st)
+{
+  assert (st < YACA_TUPLE_STRIPES);
+  pthread_mutex_lock (&yaca_tuplestripes[st].mutex);
+  unsigned size = yaca_tuplestripes[st].size;
+  if (size > 0)
+    {
+      // shrink the stripe if many tuples died
+      unsigned newsiz = size;
+      while (newsiz > YACA_TUPLE_MINSIZE
+	     && 8 * yaca_tuplestripes[st].count < newsiz)
+	newsiz /= 2;
+      tuple_stripe_rebuild (st, newsiz, tuple_gc_keep);
+    }
+  pthread_mutex_unlock (&yaca_tuplestripes[st].mutex);
+}
+
+// eof tuple.c
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <fastcgi.h>
 #include <unistd.h>
@@ -36,11 +37,15 @@
 #include <string.h>
 #include <jansson.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <signal.h>
 #include <assert.h>
 #include <errno.h>
+#include <sched.h>
 #include <limits.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <sys/time.h>
 
 #define YACA_MAX_WORKERS 16
@@ -56,8 +61,8 @@
 	   ##__VA_ARGS__);					\
     abort(); }while(0)
 
-#define YACA_LIKELY(C) !__builtin_expect(0,!(C))
-#define YACA_UNLIKELY(C) __builtin_expect(0,(C))
+#define YACA_LIKELY(C) __builtin_expect(!!(C),1)
+#define YACA_UNLIKELY(C) __builtin_expect(!!(C),0)
 
 #define YACA_SYSLOG(Lev,Fmt,...) do {			\
   pthread_mutex_lock (&yaca_syslog_mutex);		\
@@ -94,6 +99,7 @@ struct yaca_itemtype_st;
 struct yaca_dumper_st;
 struct yaca_tupleitems_st;
 struct yaca_worker_st;		/* in agenda.c */
+struct yaca_agtimer_st;		/* in agenda.c */
 extern __thread struct yaca_worker_st *yaca_this_worker;
 
 typedef struct yaca_item_st *yaca_loaditem_sig_t (json_t *, yaca_id_t);
@@ -103,6 +109,7 @@ typedef json_t *yaca_dumpcontent_sig_t (struct yaca_item_st *);
 typedef void yaca_runitem_sig_t (struct yaca_item_st *);
 typedef void yaca_scandump_sig_t (struct yaca_item_st *,
 				  struct yaca_dumper_st *);
+typedef void yaca_gcscan_sig_t (struct yaca_item_st *);
 
 
 // make a new item
@@ -128,16 +135,31 @@ typedef void yaca_scandump_sig_t (struct yaca_item_st *,
 ///// items
 
 #define YACA_ITEM_MAGIC 971394241	/*0x39e64cc1 */
-struct yaca_item_st		// in calloc-ed memory, and explicitly free-d by the GC
+struct yaca_item_st		// in item slabs, see yaca_item_make
 {
   uint32_t itm_magic;		/* always YACA_ITEM_MAGIC */
   yaca_id_t itm_id;
   yaca_typenum_t itm_typnum;
   yaca_spacenum_t itm_spacnum;
-  pthread_mutex_t itm_mutex;
+  uint32_t itm_lock;		/* lock word, see yaca_item_lock */
+  uint32_t itm_seq;		/* odd while written, for seqlock types */
+  uint32_t itm_size;		/* allocated size, to reclaim it */
+  uint32_t itm_typix;		/* shard and position in its type index */
+  uint32_t itm_spaix;		/* shard and position in its space index */
+  uint32_t itm_agstate;		/* agenda state, see agenda.c */
+  uint32_t itm_flags;		/* YACA_ITEMFLAG_* bits */
+  struct yaca_item_st *itm_agnext;	/* next in its global agenda queue */
+  struct yaca_item_st *itm_agprev;	/* previous in that queue */
+  struct yaca_agtimer_st *itm_agtimer;	/* its pending timer, if any */
   long itm_dataspace[];
 };
 #define YACA_ITEM_MAX_SIZE (256*1024*sizeof(void*))
+// copied from YACA_TYPEFLAG_SEQLOCK when the item is made
+#define YACA_ITEMFLAG_SEQLOCK 1
+// atomically set by the first destroy of the item, with the swept
+// flag if the GC did it
+#define YACA_ITEMFLAG_DESTROYED 2
+#define YACA_ITEMFLAG_SWEPT 4
 
 // make a new item
 struct yaca_item_st *yaca_item_make (yaca_typenum_t typnum,
@@ -147,18 +169,160 @@ struct yaca_item_st *yaca_item_make (yaca_typenum_t typnum,
 struct yaca_item_st *yaca_item_build (yaca_typenum_t typnum,
 				      yaca_spacenum_t spacenum,
 				      unsigned extrasize, yaca_id_t id);
-// get the item of a given id
+// get the item of a given id; a pinned thread other than the workers
+// gets NULL for an unreached item which the GC is sweeping
 struct yaca_item_st *yaca_item_of_id (yaca_id_t id);
 
+/* Destroy an item: it is removed from the agenda and from the item
+   table at once, but its memory and its id are reclaimed only after
+   the next garbage collection started, when no pinned thread can
+   still see it. The items left unreached by a collection are
+   destroyed by its sweep, just before that. Items found while pinned
+   stay valid until unpinned, even if destroyed meanwhile; pins may be
+   nested, and agenda tasks run pinned. A thread other than the workers
+   should hold items and region data only while pinned, and should not
+   wait for the workers meanwhile: its outermost pin waits while the
+   GC copies, which waits for it to unpin. The items it makes or finds
+   by id while pinned are GC roots till it unpins. */
+void yaca_item_destroy (struct yaca_item_st *itm);
+// destroy several items at once
+void yaca_items_destroy (struct yaca_item_st **itmarr, unsigned nb);
+// destroy the unreached items for the GC, but skip and remove from the
+// array those other threads are destroying; give their new number;
+// destroying an item already swept is not an error
+unsigned yaca_items_sweep (struct yaca_item_st **itmarr, unsigned nb);
+void yaca_items_pin (void);
+void yaca_items_unpin (void);
+// hold the item table, like a pin but without waiting for the GC or
+// making roots; the markers do so, to update marks more cheaply
+void yaca_items_read_begin (void);
+void yaca_items_read_end (void);
+// called by the GC when it starts copying
+void yaca_items_retire_destroyed (void);
+// called by the outermost pin of a thread other than the workers,
+// waiting while the GC copies, and by its unpin
+void yaca_gc_enter_pinned (void);
+void yaca_gc_leave_pinned (void);
+// mark as roots the items recorded by pinned threads, for the GC
+void yaca_items_mark_pinned (void);
+// called for an item recorded by a pinned thread other than the
+// workers: mark it while marking, or tell if it escaped the sweep
+bool yaca_gc_keep_item (struct yaca_item_st *itm);
+
+// apply a function to the items of a type, or of a space, till it
+// returns false; the items made or destroyed meanwhile may be missed
+// or seen; the function may be NULL, and the number of visited items
+// is returned
+unsigned long yaca_items_of_type (yaca_typenum_t typnum,
+				  bool (*fun) (struct yaca_item_st *,
+					       void *), void *data);
+unsigned long yaca_items_of_space (yaca_spacenum_t spacenum,
+				   bool (*fun) (struct yaca_item_st *,
+						void *), void *data);
+
+// the bound of item ids, and the items whose id is in [lo,hi[ ; the
+// buffer should have room for hi-lo items, their number is returned
+yaca_id_t yaca_items_bound (void);
+unsigned yaca_items_in_range (yaca_id_t lo, yaca_id_t hi,
+			      struct yaca_item_st **buf);
+
+/* The mark of items, for the garbage collector, is white when not
+   reached yet, grey when reached but not scanned, black when reached
+   and scanned. Marks are updated atomically, by several markers. */
+// shade a white item grey, return true if it was white
+bool yaca_item_shade (struct yaca_item_st *itm);
+// blacken an item, return true if it was not black
+bool yaca_item_blacken (struct yaca_item_st *itm);
+// make a marked item grey again, return true if it was marked
+bool yaca_item_regrey (struct yaca_item_st *itm);
+bool yaca_item_is_marked (struct yaca_item_st *itm);
+// make every item white
+void yaca_items_clear_marks (void);
+// after marking, give the items of [lo,hi[ which were not reached,
+// for the sweep; items made meanwhile are black so never given; the
+// buffer should have room for hi-lo items
+unsigned yaca_items_unmarked_in_range (yaca_id_t lo, yaca_id_t hi,
+				       struct yaca_item_st **buf);
+
 // touch an item (write barrier for the GC) --forwarded definition
 static inline void yaca_item_touch (struct yaca_item_st *itm);
 
+/* Items are locked recursively thru their 4 bytes lock word, which
+   holds the locking thread number, the recursion depth and a
+   contention bit. A contended lock waits on a futex. Deeper recursion
+   is counted in the locking thread. Each thread gets its number when
+   it first locks an item. */
+#define YACA_ITEMLOCK_CONTENDED 1
+#define YACA_ITEMLOCK_DEPTHSHIFT 1
+#define YACA_ITEMLOCK_DEPTHMAX 255
+#define YACA_ITEMLOCK_OWNERSHIFT 9
+extern __thread uint32_t yaca_this_locker;
+static inline void yaca_item_lock (struct yaca_item_st *itm);
+static inline void yaca_item_unlock (struct yaca_item_st *itm);
+void yaca_item_lock_slow (struct yaca_item_st *itm);
+void yaca_item_unlock_slow (struct yaca_item_st *itm);
+
+/* Items of a type with YACA_TYPEFLAG_SEQLOCK also have a sequence
+   counter, made odd by the outermost yaca_item_lock and even again by
+   the matching yaca_item_unlock. Readers may then avoid the lock:
+
+     uint32_t seq;
+     do {
+       seq = yaca_item_read_begin (itm);
+       ... copy what is needed from the item ...
+     } while (yaca_item_read_retry (itm, seq));
+
+   The copied data should not be used before the loop ends, since it
+   may be torn by a writer. */
+static inline uint32_t yaca_item_read_begin (struct yaca_item_st *itm);
+static inline bool yaca_item_read_retry (struct yaca_item_st *itm,
+					 uint32_t seq);
+
+// flush the store buffer of the current worker into the remembered set
+void yaca_flush_touched (void);
+
+// take the remembered set of items touched since the previous take,
+// at a safepoint; the malloc-ed array should be freed by the caller
+unsigned yaca_remembered_set_take (struct yaca_item_st ***parr);
+
+struct yaca_barrier_stats_st
+{
+  unsigned long bst_cachehits;	/* touches caught by the touch cache */
+  unsigned long bst_barrierhits;	/* touches recorded by the barrier */
+  unsigned long bst_flushes;	/* flushes into the remembered set */
+  unsigned long bst_flushed;	/* items flushed in all flushes */
+  unsigned long bst_maxflush;	/* biggest flush */
+};
+void yaca_barrier_stats (struct yaca_barrier_stats_st *st);
+
 
+/* Tuples of items are immutable, and allocated in region memory by
+   yaca_work_allocate, so they are moved by the GC: an item keeping a
+   tuple should update it in its typr_gcscan routine with
+   yaca_tuple_gcscan. Hash-consed tuples are unique, so two of them
+   are equal only when they are the same pointer. */
 struct yaca_tupleitems_st
 {
   unsigned tup_len;
+  unsigned tup_hash;		/* cached, never 0 */
+  unsigned tup_consed;		/* set if hash-consed */
   struct yaca_item_st *tup_items[];
 };
+// make a fresh tuple, or a hash-consed one
+struct yaca_tupleitems_st *yaca_tuple_make (unsigned len,
+					    struct yaca_item_st **items);
+struct yaca_tupleitems_st *yaca_tuple_cons (unsigned len,
+					    struct yaca_item_st **items);
+bool yaca_tuple_equal (const struct yaca_tupleitems_st *tup1,
+		       const struct yaca_tupleitems_st *tup2);
+// mark the items of a tuple and give its new address; to be called
+// by typr_gcscan routines
+struct yaca_tupleitems_st *yaca_tuple_gcscan (struct yaca_tupleitems_st
+					      *tup);
+// called by the GC workers after copying, for each stripe, to update
+// the hash-consed tuples and forget those mentioning destroyed items
+#define YACA_TUPLE_STRIPES 16
+void yaca_tuples_gc_fixup (unsigned stripe);
 
 ///// types
 #define YACA_TYPE_MAGIC 657176525	/* 0x272bb7cd */
@@ -174,8 +338,13 @@ struct yaca_itemtype_st
   yaca_dumpitem_sig_t *typr_dumpitem;
   yaca_dumpcontent_sig_t *typr_dumpcontent;
   yaca_runitem_sig_t *typr_runitem;
-  void *typ_spare_[10];
+  yaca_gcscan_sig_t *typr_gcscan;	/* forward the region data of an item */
+  uint32_t typ_flags;		/* YACA_TYPEFLAG_* bits */
+  void *typ_spare_[8];
 };
+// the items of the type can be read optimistically, see
+// yaca_item_read_begin
+#define YACA_TYPEFLAG_SEQLOCK 1
 #define YACA_ITEM_MAX_TYPE 4096
 extern struct yaca_itemtype_st *yaca_typetab[];
 
@@ -195,6 +364,7 @@ extern struct yaca_space_st *yaca_spacetab[];
 // memory region
 #define YACA_SMALLREGION_MAGIC 1379233909	/* 0x52357075 */
 #define YACA_BIGREGION_MAGIC 1260589607	/* 0x4b231227 */
+#define YACA_LARGEREGION_MAGIC 1149478597	/* 0x4483a6c5 */
 
 // region sizes are large power of two, and are aligned to their size */
 #define SMALLREGION_LOG 20
@@ -206,8 +376,9 @@ extern struct yaca_space_st *yaca_spacetab[];
 struct yaca_region_st
 {
   unsigned reg_magic;		/* YACA_SMALLREGION_MAGIC or
-				   YACA_BIGREGION_MAGIC */
-  unsigned reg_index;		/* index in smallregion or bigregion */
+				   YACA_BIGREGION_MAGIC or
+				   YACA_LARGEREGION_MAGIC */
+  unsigned reg_index;		/* first slot in the page map */
   uint16_t reg_state;
   uint64_t reg_spare1;
   uint64_t reg_spare2;
@@ -219,6 +390,56 @@ struct yaca_region_st
 };
 #define YACA_REGION_EMPTY ((struct yaca_region_st*)-1L)
 
+// bits of reg_state
+#define YACA_REGSTATE_FROMSPACE 1	/* being evacuated by the GC */
+#define YACA_REGSTATE_LIVE 2	/* large region reached by the GC */
+#define YACA_REGSTATE_PINNED 4	/* large region of a thread not stopped
+				   by the GC */
+
+/* Allocations of at least half a big region go into a large region of
+   their own, mapped individually and never copied by the GC. */
+
+// create a new small or big region
+struct yaca_region_st *yaca_new_smallregion (void);
+struct yaca_region_st *yaca_new_bigregion (void);
+
+// delete a region, during garbage collection
+void yaca_delete_region (struct yaca_region_st *reg);
+
+// find the region containing some pointer, or NULL; never locks
+struct yaca_region_st *yaca_find_region (void *ptr);
+
+// the total size of allocated small & big regions
+long yaca_allocated_megabytes (void);
+
+// the total size of allocated large regions
+long yaca_large_allocated_megabytes (void);
+
+// counters of work allocations, to check that few of them take a lock
+struct yaca_alloc_stats_st
+{
+  unsigned long als_allocations;	/* all the work allocations */
+  unsigned long als_locked;	/* allocations which took a mutex */
+  unsigned als_nbtlabs;		/* thread-local buffers of non-workers */
+};
+void yaca_alloc_stats (struct yaca_alloc_stats_st *st);
+
+// retired regions are pooled between these watermarks (in megabytes)
+extern long yaca_regpool_high_megabytes;
+extern long yaca_regpool_low_megabytes;
+
+struct yaca_regionpool_stats_st
+{
+  unsigned long rps_smallhits;	/* small regions reused from the pool */
+  unsigned long rps_smallmisses;	/* small regions freshly mapped */
+  unsigned long rps_bighits;
+  unsigned long rps_bigmisses;
+  unsigned rps_nbsmall;		/* pooled small regions */
+  unsigned rps_nbbig;		/* pooled big regions */
+  long rps_megabytes;		/* total size of pooled regions */
+};
+void yaca_region_pool_stats (struct yaca_regionpool_stats_st *st);
+
 // quickly allocate in a region -without any locking- or NULL if full
 static inline void *
 yaca_allocate_in_region (struct yaca_region_st *reg, unsigned siz)
@@ -230,7 +451,7 @@ yaca_allocate_in_region (struct yaca_region_st *reg, unsigned siz)
   if (YACA_UNLIKELY (siz % YACA_MINALIGNMENT != 0))
     siz = (siz | (YACA_MINALIGNMENT - 1)) + 1;
   void *p = reg->reg_free;
-  if (YACA_LIKELY ((char *) p + siz < (char *) reg->reg_end))
+  if (YACA_LIKELY ((char *) p + siz <= (char *) reg->reg_end))
     {
       reg->reg_free = (char *) p + siz;
       return p;
@@ -277,6 +498,7 @@ enum yaca_interrupt_reason_en
 };
 
 #define YACA_WORKER_TOUCH_CACHE_LEN 17	/* a small prime number */
+#define YACA_WORKER_STORE_BUFFER_LEN 256	/* touched items before flush */
 #define YACA_WORKER_MAGIC 471856441	/*0x1c1ff539 */
 struct yaca_worker_st
 {
@@ -287,10 +509,23 @@ struct yaca_worker_st
   timer_t worker_timer;
   uint32_t worker_need;
   struct yaca_region_st *worker_region;
+  struct yaca_region_st *worker_bigregion;
+  unsigned long worker_nballoc;	/* number of work allocations */
   volatile sig_atomic_t worker_interrupted;
   struct yaca_item_st *worker_touchcache[YACA_WORKER_TOUCH_CACHE_LEN];
+  /* sequential store buffer of touched items, flushed in batches into
+     the remembered set */
+  unsigned worker_storelen;
+  struct yaca_item_st *worker_storebuf[YACA_WORKER_STORE_BUFFER_LEN];
+  /* write barrier counters */
+  unsigned long worker_touchcachehits;
+  unsigned long worker_touchbarrierhits;
+  unsigned long worker_touchflushes;
+  unsigned long worker_touchflushed;
 };
 
+extern struct yaca_worker_st yaca_worktab[];
+
 #define YACA_WORKER_SIGNAL SIGALRM
 #define YACA_WORKER_TICKMILLISEC 25	/* milliseconds */
 void yaca_load (void);
@@ -298,15 +533,23 @@ void yaca_load (void);
 void yaca_start_agenda (void);
 void yaca_interrupt_agenda (enum yaca_interrupt_reason_en reason);
 
+/* Task priorities go from 1 to tkprio__last-1, the highest run
+   first; the named ones are landmarks, and any value in between is
+   valid. There are at most 64 of them, see agenda.c */
 enum yaca_taskprio_en
 {
-  tkprio__none,
-  tkprio_low,
-  tkprio_normal,
-  tkprio_high,
-  tkprio__last
+  tkprio__none = 0,
+  tkprio_low = 16,
+  tkprio_normal = 32,
+  tkprio_high = 48,
+  tkprio__last = 64
 };
 
+// the priority of a task which should run within some delay in
+// seconds, from tkprio_normal for delays of weeks or more to
+// tkprio__last-1 for delays below a millisecond
+enum yaca_taskprio_en yaca_deadline_prio (double delay);
+
 
 // return false if failed to add or move
 bool yaca_agenda_add_back (struct yaca_item_st *itmtask,
@@ -314,9 +557,22 @@ bool yaca_agenda_add_back (struct yaca_item_st *itmtask,
 // return false if failed to add or move
 bool yaca_agenda_add_front (struct yaca_item_st *itmtask,
 			    enum yaca_taskprio_en prio);
-
-// remove a task item, return tkprio__none if failed to remove else
-// its old priority
+// add or move at the back several task items of the same priority,
+// waking at most as many workers, return the number added
+unsigned yaca_agenda_add_batch (struct yaca_item_st **itmtasks, unsigned nb,
+				enum yaca_taskprio_en prio);
+// add a task item at the back after some delay in seconds, replacing
+// its pending timer if any; return false if failed
+bool yaca_agenda_add_after (struct yaca_item_st *itmtask,
+			    enum yaca_taskprio_en prio, double delay);
+// add a task item at the back after some delay, then every period in
+// seconds, until removed; return false if failed
+bool yaca_agenda_add_periodic (struct yaca_item_st *itmtask,
+			       enum yaca_taskprio_en prio, double delay,
+			       double period);
+
+// remove a task item, and cancel its pending timer, return
+// tkprio__none if failed to remove else its old priority
 enum yaca_taskprio_en yaca_agenda_remove (struct yaca_item_st *itmtask);
 
 // query the priority of an item, or tkprio__none if not found
@@ -335,6 +591,11 @@ void yaca_wait_workers_all_at_state (unsigned state);
 // allocate from a worker (preferably), and ask for GC when needed
 void *yaca_work_allocate (unsigned siz);
 
+// called by a thread other than the workers when it keeps no pointer
+// to region data except in items, so the GC may then move or free
+// what it allocated before; till then, that data is pinned
+void yaca_work_safepoint (void);
+
 // signal that a garbage collection is needed
 void yaca_should_garbage_collect (void);
 
@@ -346,6 +607,59 @@ void *yaca_gcthread_work (void *);
 // this is called by worker threads when GC is needed
 void yaca_worker_garbcoll (void);
 
+// during garbage collection, give the new address of some region
+// data, copying it if needed; to be called by typr_gcscan routines
+void *yaca_gc_forward (void *ptr);
+
+// after copying, give the new address of some region data, or NULL
+// if it was not forwarded; for the weak references of the GC
+void *yaca_gc_forwarded (void *ptr);
+
+// during marking, mark an item referenced by the scanned one; to be
+// called by typr_gcscan routines
+void yaca_gc_mark_item (struct yaca_item_st *itm);
+
+// mark the task items of the agenda, which are GC roots
+void yaca_agenda_gcmark (void);
+
+// forget the stale slots of the task deques, with the workers stopped
+void yaca_agenda_gc_purge (void);
+
+/* In stop-the-world mode, all marking happens while every worker is
+   in GC state. In concurrent mode, the GC thread marks while the
+   workers run their tasks, and the workers only stop for a final
+   remark and the copying. */
+enum yaca_gcmode_en
+{
+  yagc_stoptheworld,
+  yagc_concurrent
+};
+extern enum yaca_gcmode_en yaca_gc_mode;
+
+// the heap growth allowed between collections, and a cap on the heap
+// in megabytes, or 0
+extern double yaca_gc_growth_factor;
+extern long yaca_gc_heapcap_megabytes;
+// the heap size, in megabytes, which triggers the next collection
+long yaca_gc_trigger_megabytes (void);
+
+// a new JSON object describing the last collections and their pauses;
+// the GC thread also dumps it to syslog on SIGUSR1
+json_t *yaca_gc_telemetry_json (void);
+
+// non-zero while the GC is marking, or sweeping the unreached items;
+// items made meanwhile are allocated black
+#define YACA_GC_MARKING 1
+#define YACA_GC_SWEEPING 2
+extern int yaca_gc_marking;
+
+// snapshot the references of an item about to be modified, while
+// concurrently marking; does nothing while sweeping
+void yaca_gc_snapshot_item (struct yaca_item_st *itm);
+
+// in concurrent mode, start marking in the GC thread
+void yaca_gc_start_concurrent_mark (void);
+
 
 static inline void
 yaca_item_touch (struct yaca_item_st *itm)
@@ -354,6 +668,8 @@ yaca_item_touch (struct yaca_item_st *itm)
   if (YACA_UNLIKELY (itm == NULL))
     return;
   assert (itm->itm_magic == YACA_ITEM_MAGIC);
+  if (YACA_UNLIKELY (__atomic_load_n (&yaca_gc_marking, __ATOMIC_RELAXED)))
+    yaca_gc_snapshot_item (itm);
   if (yaca_this_worker)
     {
       yaca_id_t id = itm->itm_id;
@@ -362,10 +678,94 @@ yaca_item_touch (struct yaca_item_st *itm)
 	  || yaca_this_worker->worker_touchcache[(id + 1) %
 						 YACA_WORKER_TOUCH_CACHE_LEN]
 	  == itm)
-	return;
+	{
+	  yaca_this_worker->worker_touchcachehits++;
+	  return;
+	}
     }
   yaca_item_really_touch (itm);
 }
 
+static inline bool
+yaca_item_is_seqlocked (struct yaca_item_st *itm)
+{
+  return (__atomic_load_n (&itm->itm_flags, __ATOMIC_RELAXED)
+	  & YACA_ITEMFLAG_SEQLOCK) != 0;
+}
+
+// called by the lock owner, after its outermost lock
+static inline void
+yaca_item_seq_write_begin (struct yaca_item_st *itm)
+{
+  if (YACA_LIKELY (!yaca_item_is_seqlocked (itm)))
+    return;
+  __atomic_store_n (&itm->itm_seq, itm->itm_seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+// called by the lock owner, before its outermost unlock
+static inline void
+yaca_item_seq_write_end (struct yaca_item_st *itm)
+{
+  if (YACA_LIKELY (!yaca_item_is_seqlocked (itm)))
+    return;
+  __atomic_store_n (&itm->itm_seq, itm->itm_seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t
+yaca_item_read_begin (struct yaca_item_st *itm)
+{
+  assert (itm && itm->itm_magic == YACA_ITEM_MAGIC
+	  && yaca_item_is_seqlocked (itm));
+  uint32_t seq = 0;
+  while (YACA_UNLIKELY
+	 ((seq = __atomic_load_n (&itm->itm_seq, __ATOMIC_ACQUIRE)) & 1))
+    sched_yield ();
+  return seq;
+}
+
+static inline bool
+yaca_item_read_retry (struct yaca_item_st *itm, uint32_t seq)
+{
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+  return __atomic_load_n (&itm->itm_seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void
+yaca_item_lock (struct yaca_item_st *itm)
+{
+  uint32_t zero = 0;
+  assert (itm && itm->itm_magic == YACA_ITEM_MAGIC);
+  if (YACA_LIKELY (yaca_this_locker != 0
+		   && __atomic_compare_exchange_n (&itm->itm_lock, &zero,
+						   yaca_this_locker
+						   << YACA_ITEMLOCK_OWNERSHIFT,
+						   false, __ATOMIC_ACQUIRE,
+						   __ATOMIC_RELAXED)))
+    {
+      yaca_item_seq_write_begin (itm);
+      return;
+    }
+  yaca_item_lock_slow (itm);
+}
+
+static inline void
+yaca_item_unlock (struct yaca_item_st *itm)
+{
+  uint32_t owned = yaca_this_locker << YACA_ITEMLOCK_OWNERSHIFT;
+  assert (itm && itm->itm_magic == YACA_ITEM_MAGIC);
+  // not recursive and not contended
+  // the outermost unlock ends the write section of seqlocked items
+  if (YACA_LIKELY (owned != 0)
+      && __atomic_load_n (&itm->itm_lock, __ATOMIC_RELAXED) == owned)
+    yaca_item_seq_write_end (itm);
+  if (YACA_LIKELY (owned != 0
+		   && __atomic_compare_exchange_n (&itm->itm_lock, &owned, 0,
+						   false, __ATOMIC_RELEASE,
+						   __ATOMIC_RELAXED)))
+    return;
+  yaca_item_unlock_slow (itm);
+}
+
 #endif /* _YACA_H_INCLUDED_ */
 /* eof yacasys/yaca.h */